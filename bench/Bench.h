@@ -0,0 +1,40 @@
+#pragma once
+
+// Helpers shared by the native benchmarks.
+// Each result is printed as a JSON object on its own line, so that runs can be compared between releases:
+//
+//     <Benchmark> [filter]
+//
+// runs the benchmarks whose name contains `filter` (all of them by default).
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+namespace Bench
+{
+    static const char* filter = "";
+
+    // Reads the filter, and prints the context of the run first
+    inline void Initialize(int argc, char* argv[]) {
+        if (argc > 1)
+            filter = argv[1];
+        printf("{\"hardwareConcurrency\":%u}\n", std::thread::hardware_concurrency());
+    }
+
+    inline bool Enabled(const char* name) {
+        return strstr(name, filter) != NULL;
+    }
+
+    inline double Now() {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Prints a result: nanoseconds per operation, with the parameters of the run
+    inline void Report(const char* name, const char* parameter, long value, long operations, double nanoseconds) {
+        printf("{\"benchmark\":\"%s\",\"%s\":%ld,\"operations\":%ld,\"nsPerOp\":%.1f}\n",
+               name, parameter, value, operations, nanoseconds / operations);
+        fflush(stdout);
+    }
+}
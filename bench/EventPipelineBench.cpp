@@ -0,0 +1,166 @@
+// Microbenchmarks of the native event pipeline, see Bench.h for the output
+
+#include "AsyncEventQueue.h"
+#include "Bench.h"
+
+#include <mutex>
+#include <queue>
+#include <vector>
+
+using namespace Bench;
+
+// ************************************************
+// Event queue
+// ************************************************
+
+// Record queued for each event, as in JSTaskDialog
+struct Event {
+    void* td;
+    int event;
+    int type;
+    int value;
+    unsigned long long queuedAt;
+};
+
+// The queue used before the lock-free ring: a heap-allocated record and payload per event,
+// in a std::queue guarded by a lock
+class LockedEventQueue {
+
+    public:
+
+        struct Payload {
+            virtual ~Payload() {}
+            int value;
+        };
+
+        struct Baton {
+            void* td;
+            int event;
+            Payload* payload;
+        };
+
+        void Push(const Event& event) {
+            Baton* baton = new Baton();
+            baton->td = event.td;
+            baton->event = event.event;
+            baton->payload = new Payload();
+            baton->payload->value = event.value;
+            std::lock_guard<std::mutex> lock(_mutex);
+            _batons.push(baton);
+        }
+
+        // Takes all the queued events, then frees them
+        long Drain() {
+            std::vector<Baton*> batons;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                while (!_batons.empty()) {
+                    batons.push_back(_batons.front());
+                    _batons.pop();
+                }
+            }
+            for (size_t i = 0; i < batons.size(); i++) {
+                delete batons[i]->payload;
+                delete batons[i];
+            }
+            return (long)batons.size();
+        }
+
+    private:
+
+        std::mutex _mutex;
+        std::queue<Baton*> _batons;
+};
+
+static const LONG QueueCapacity = 1024;
+static AsyncEventQueue<Event, QueueCapacity> ringQueue;
+static LockedEventQueue lockedQueue;
+
+// Cost of raising an event from `producers` dialog threads at once, while the main thread drains the queue.
+// A producer finding the ring full retries: the time spent waiting is part of the cost.
+template<typename Push, typename Drain>
+static void BenchmarkEnqueue(const char* name, int producers, long eventsPerProducer, Push push, Drain drain) {
+    long total = producers * eventsPerProducer;
+    std::vector<std::thread> threads;
+    double start = Now();
+    for (int p = 0; p < producers; p++) {
+        threads.push_back(std::thread([&, p]() {
+            Event event = { &threads, 3, 1, 0, 0 };
+            for (long i = 0; i < eventsPerProducer; i++) {
+                event.value = (int)i;
+                push(event);
+            }
+        }));
+    }
+    for (long received = 0; received < total; ) {
+        long drained = drain();
+        if (!drained)
+            std::this_thread::yield();
+        received += drained;
+    }
+    double elapsed = Now() - start;
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    Report(name, "producers", producers, total, elapsed);
+}
+
+// Cost of taking a batch of `batchSize` events on the main thread
+template<typename Push, typename Drain>
+static void BenchmarkDrain(const char* name, long batchSize, Push push, Drain drain) {
+    long rounds = 2000000 / batchSize;
+    Event event = { &rounds, 3, 1, 0, 0 };
+    double elapsed = 0;
+    for (long round = 0; round < rounds; round++) {
+        for (long i = 0; i < batchSize; i++)
+            push(event);
+        double start = Now();
+        drain();
+        elapsed += Now() - start;
+    }
+    Report(name, "batchSize", batchSize, rounds * batchSize, elapsed);
+}
+
+static void PushRing(const Event& event) {
+    while (!ringQueue.Push(event))
+        std::this_thread::yield();
+}
+
+static long DrainRing() {
+    Event event;
+    long drained = 0;
+    while (drained < QueueCapacity && ringQueue.Pop(event))
+        drained++;
+    return drained;
+}
+
+static void PushLocked(const Event& event) {
+    lockedQueue.Push(event);
+}
+
+static long DrainLocked() {
+    return lockedQueue.Drain();
+}
+
+static void BenchmarkEventQueue() {
+    static const int producers[] = { 1, 2, 4, 8, 16 };
+    static const long batchSizes[] = { 1, 16, 256, 1024 };
+
+    for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); i++) {
+        if (Enabled("enqueue/ring"))
+            BenchmarkEnqueue("enqueue/ring", producers[i], 1000000 / producers[i], PushRing, DrainRing);
+        if (Enabled("enqueue/locked"))
+            BenchmarkEnqueue("enqueue/locked", producers[i], 1000000 / producers[i], PushLocked, DrainLocked);
+    }
+    for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); i++) {
+        if (Enabled("drain/ring"))
+            BenchmarkDrain("drain/ring", batchSizes[i], PushRing, DrainRing);
+        if (Enabled("drain/locked"))
+            BenchmarkDrain("drain/locked", batchSizes[i], PushLocked, DrainLocked);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Initialize(argc, argv);
+    BenchmarkEventQueue();
+    return 0;
+}
@@ -0,0 +1,292 @@
+// Benchmarks of the event and update paths on headless dialogs, see Bench.h for the output.
+// The dialogs run on their own threads with HeadlessBackend, like in the addon, and the main thread plays
+// the part of the Node loop. The paths run the helpers shipped in the addon, which do not need V8 nor ATL:
+// the OverflowEventQueue and LatestValueSlot of JSTaskDialog for the events, and the CommandQueue and
+// UpdateCombiner of Kerr::TaskDialog, applied from a hook on the dialog thread, for the updates.
+
+#include "EventPipeline.h"
+#include "UpdatePipeline.h"
+#include "HeadlessBackend.h"
+#include "LatencyHistogram.h"
+#include "Bench.h"
+
+#include <vector>
+
+using namespace Bench;
+
+// ************************************************
+// Events
+// ************************************************
+
+// Record queued for each event, as in JSTaskDialog.
+// A coalesced tick carries no value: it takes the latest one from the slot of its dialog when it is delivered.
+struct Event {
+    int dialog;
+    DWORD milliseconds;
+    bool coalesced;
+    double queuedAt;
+};
+
+static const LONG EventsCapacity = 1024;
+static OverflowEventQueue<Event, EventsCapacity>* events;
+static std::vector<LatestValueSlot>* timerSlots;
+static bool coalesceTimer;
+static HANDLE eventsWakeUp;    // Stands for the uv_async_t of the main thread
+static volatile LONG coalescedEvents;
+
+// Raises the ticks like JSTaskDialog::OnTimer and RaiseJSEvent
+static HRESULT CALLBACK TimerCallback(HWND /*handle*/, UINT notification, WPARAM wParam, LPARAM /*lParam*/, LONG_PTR data) {
+    if (notification != TDN_TIMER)
+        return S_OK;
+    Event event = { static_cast<int>(data), static_cast<DWORD>(wParam), coalesceTimer, Now() };
+    if (coalesceTimer && !(*timerSlots)[event.dialog].Set(static_cast<LONG>(wParam))) {
+        InterlockedIncrement(&coalescedEvents);
+        return S_OK;
+    }
+
+    switch (events->Push(event, true)) {
+        case OverflowEventQueue<Event, EventsCapacity>::Queued:
+            SetEvent(eventsWakeUp);
+            return S_OK;
+        case OverflowEventQueue<Event, EventsCapacity>::Skipped:
+            InterlockedIncrement(&coalescedEvents);
+            break;
+        default:
+            break;
+    }
+    if (coalesceTimer)
+        (*timerSlots)[event.dialog].Clear();
+    return S_OK;
+}
+
+// Ticks of `dialogs` dialogs ticking every millisecond for `milliseconds`, one by one or coalesced.
+// The latencies, in microseconds, go from the notification to the main thread.
+static void BenchmarkEvents(const char* name, bool coalesce, int dialogs, DWORD milliseconds) {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(1);
+    backend.SetCloseAfter(milliseconds);
+    OverflowEventQueue<Event, EventsCapacity> queue;
+    std::vector<LatestValueSlot> slots(dialogs);
+    events = &queue;
+    timerSlots = &slots;
+    coalesceTimer = coalesce;
+    eventsWakeUp = CreateEventW(NULL, FALSE, FALSE, NULL);
+    coalescedEvents = 0;
+
+    TASKDIALOGCONFIG config = TASKDIALOGCONFIG();
+    config.cbSize = sizeof(TASKDIALOGCONFIG);
+    config.dwFlags = TDF_CALLBACK_TIMER;
+    config.pfCallback = TimerCallback;
+    std::vector<TASKDIALOGCONFIG> configs(dialogs, config);
+
+    volatile LONG closed = 0;
+    std::vector<std::thread> threads;
+    double start = Now();
+    for (int i = 0; i < dialogs; i++) {
+        configs[i].lpCallbackData = i;
+        threads.push_back(std::thread([&, i]() {
+            backend.ShowDialog(&configs[i], NULL, NULL, NULL);
+            InterlockedIncrement(&closed);
+            SetEvent(eventsWakeUp);
+        }));
+    }
+
+    // Drains the queue like JSTaskDialog::AsyncMessageHandler, and takes the latest value of the coalesced ticks
+    // like JSTaskDialog::DeliverMessage
+    LatencyHistogram latency;
+    DWORD lastMilliseconds = 0;
+    for (;;) {
+        bool done = LoadAcquire(closed) == dialogs;
+        LONG processed = queue.Drain([&](Event& event) {
+            if (event.coalesced)
+                event.milliseconds = (DWORD)slots[event.dialog].Take();
+            lastMilliseconds = event.milliseconds;
+            latency.Record((uint64_t)(Now() - event.queuedAt));
+        });
+        if (done && processed < EventsCapacity)
+            break;
+        if (processed < EventsCapacity)
+            WaitForSingleObject(eventsWakeUp, INFINITE);
+    }
+    double elapsed = Now() - start;
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    CloseHandle(eventsWakeUp);
+
+    printf("{\"benchmark\":\"%s\",\"dialogs\":%d,\"events\":%llu,\"eventsPerSecond\":%.0f,"
+           "\"queueP50\":%llu,\"queueP99\":%llu,\"queueMax\":%llu,\"coalescedEvents\":%ld,\"droppedEvents\":%ld,"
+           "\"lastMilliseconds\":%lu}\n",
+           name, dialogs, (unsigned long long)latency.GetCount(), latency.GetCount() / (elapsed / 1e9),
+           (unsigned long long)latency.GetPercentile(50), (unsigned long long)latency.GetPercentile(99),
+           (unsigned long long)latency.GetMax(), (long)coalescedEvents, (long)queue.GetDroppedEvents(),
+           (unsigned long)lastMilliseconds);
+    fflush(stdout);
+}
+
+// ************************************************
+// Updates
+// ************************************************
+
+// A visible dialog on its own thread, updated from the main thread in one of three ways:
+// a SendMessage per update, commands queued with a single posted message to process them all
+// (Kerr::TaskDialog::PostCommand), or only the latest value, applied by a posted flush (CombineUpdate)
+class UpdatedDialog {
+
+    public:
+
+        enum Mode {
+            ModeSend,
+            ModeQueued,
+            ModeCombined
+        };
+
+        UpdatedDialog(HeadlessBackend& backend, Mode mode) :
+            _backend(backend),
+            _mode(mode),
+            _handle(NULL),
+            _pendingPosition(0),
+            _applied(0),
+            _lastPosition(-1)
+        {
+            _config = TASKDIALOGCONFIG();
+            _config.cbSize = sizeof(TASKDIALOGCONFIG);
+            _config.dwFlags = TDF_SHOW_PROGRESS_BAR;
+            _config.pfCallback = Callback;
+            _config.lpCallbackData = reinterpret_cast<LONG_PTR>(this);
+            _thread = std::thread([this]() {
+                _backend.ShowDialog(&_config, NULL, NULL, NULL);
+            });
+            while (!LoadAcquire(_handle))
+                std::this_thread::yield();
+        }
+
+        ~UpdatedDialog() {
+            _backend.SendDialogMessage(_handle, TDM_CLICK_BUTTON, IDOK);
+            _thread.join();
+        }
+
+        void SetPosition(int position) {
+            switch (_mode) {
+                case ModeSend:
+                    _backend.SendDialogMessage(_handle, TDM_SET_PROGRESS_BAR_POS, position);
+                    break;
+                case ModeQueued:
+                    _commands.Push(&_backend, _handle, ProcessMessage, position);
+                    break;
+                case ModeCombined:
+                    InterlockedExchange(&_pendingPosition, position);
+                    _updates.Combine(PendingPosition);
+                    _updates.RequestFlush(&_backend, _handle, ProcessMessage);
+                    break;
+            }
+        }
+
+        // Waits until the dialog shows the given position
+        void WaitFor(int position) {
+            while (LoadAcquire(_lastPosition) != position)
+                std::this_thread::yield();
+        }
+
+        LONG GetApplied() const {
+            return _applied;
+        }
+
+        LONG GetElided() const {
+            return _updates.GetElidedUpdates();
+        }
+
+    private:
+
+        static const UINT ProcessMessage = WM_USER + 0x100;
+        static const LONG PendingPosition = 4;
+
+        HeadlessBackend& _backend;
+        Mode _mode;
+        TASKDIALOGCONFIG _config;
+        std::thread _thread;
+        HWND volatile _handle;
+        CommandQueue<LONG, 256> _commands;
+        UpdateCombiner _updates;
+        volatile LONG _pendingPosition;
+        volatile LONG _applied;
+        volatile LONG _lastPosition;
+
+        void Apply(LONG position) {
+            _backend.SendDialogMessage(_handle, TDM_SET_PROGRESS_BAR_POS, position);
+            InterlockedIncrement(&_applied);
+            StoreRelease(_lastPosition, position);
+        }
+
+        static HRESULT CALLBACK Callback(HWND handle, UINT notification, WPARAM /*wParam*/, LPARAM /*lParam*/, LONG_PTR data) {
+            UpdatedDialog* dialog = reinterpret_cast<UpdatedDialog*>(data);
+            if (notification == TDN_DIALOG_CONSTRUCTED) {
+                dialog->_backend.SetDialogHook(handle, Hook, data);
+            } else if (notification == TDN_CREATED) {
+                StoreRelease(dialog->_handle, handle);
+            } else if (notification == TDN_DESTROYED) {
+                dialog->_backend.RemoveDialogHook(handle, Hook);
+            }
+            return S_OK;
+        }
+
+        // Processes the commands like Kerr::TaskDialog::ProcessCommands, or applies the latest value
+        // like Kerr::TaskDialog::FlushUpdates (without its minimum interval)
+        static bool Hook(HWND /*handle*/, UINT message, WPARAM wParam, LPARAM /*lParam*/, DWORD_PTR data, LRESULT* result) {
+            UpdatedDialog* dialog = reinterpret_cast<UpdatedDialog*>(data);
+            if (message == TDM_SET_PROGRESS_BAR_POS && dialog->_mode == ModeSend) {
+                InterlockedIncrement(&dialog->_applied);
+                StoreRelease(dialog->_lastPosition, static_cast<LONG>(wParam));
+                return false;
+            }
+            if (message != ProcessMessage)
+                return false;
+
+            if (dialog->_mode == ModeQueued) {
+                dialog->_commands.BeginProcessing();
+                LONG position;
+                while (dialog->_commands.Pop(position))
+                    dialog->Apply(position);
+            } else if (dialog->_updates.BeginFlush() & PendingPosition) {
+                dialog->Apply(LoadAcquire(dialog->_pendingPosition));
+            }
+            *result = TRUE;
+            return true;
+        }
+};
+
+// Cost of `updates` progress bar updates from the main thread, until the last one is shown
+static void BenchmarkUpdates(const char* name, UpdatedDialog::Mode mode, long updates) {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(0);
+    UpdatedDialog dialog(backend, mode);
+
+    double start = Now();
+    for (long i = 1; i <= updates; i++)
+        dialog.SetPosition((int)i);
+    dialog.WaitFor((int)updates);
+    double elapsed = Now() - start;
+
+    printf("{\"benchmark\":\"%s\",\"updates\":%ld,\"applied\":%ld,\"elided\":%ld,\"nsPerOp\":%.1f}\n",
+           name, updates, (long)dialog.GetApplied(), (long)dialog.GetElided(), elapsed / updates);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    Initialize(argc, argv);
+
+    static const int dialogCounts[] = { 1, 8, 64 };
+    for (size_t i = 0; i < sizeof(dialogCounts) / sizeof(dialogCounts[0]); i++) {
+        if (Enabled("events/timer"))
+            BenchmarkEvents("events/timer", false, dialogCounts[i], 1000);
+        if (Enabled("events/coalesced"))
+            BenchmarkEvents("events/coalesced", true, dialogCounts[i], 1000);
+    }
+
+    if (Enabled("updates/send"))
+        BenchmarkUpdates("updates/send", UpdatedDialog::ModeSend, 100000);
+    if (Enabled("updates/queued"))
+        BenchmarkUpdates("updates/queued", UpdatedDialog::ModeQueued, 1000000);
+    if (Enabled("updates/combined"))
+        BenchmarkUpdates("updates/combined", UpdatedDialog::ModeCombined, 1000000);
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Microbenchmarks of the string conversions done by the property setters, see Bench.h for the output
+
+#include "Utf8.h"
+#include "Bench.h"
+
+#include <codecvt>
+#include <locale>
+#include <string>
+#include <vector>
+
+using namespace Bench;
+
+// ************************************************
+// UTF-8 to UTF-16
+// ************************************************
+
+// The conversion used before Utf8::ToUtf16: a converter and an intermediate std::wstring per string
+static wchar_t* ConvertWithCodecvt(const std::string& source) {
+    std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+    std::wstring wsource = converter.from_bytes(source);
+    wchar_t* wdest = new wchar_t[wsource.length() + 1];
+    size_t charsCopied = wsource.copy(wdest, wsource.length());
+    wdest[charsCopied] = L'\0';
+    return wdest;
+}
+
+static wchar_t* ConvertWithUtf8(const std::string& source) {
+    wchar_t* wdest = new wchar_t[source.length() + 1];
+    Utf8::ToUtf16(wdest, source.data(), source.length());
+    return wdest;
+}
+
+// Text of `bytes` bytes made of the given character, padded with ASCII
+static std::string MakeText(const char* character, size_t bytes) {
+    std::string text;
+    size_t length = strlen(character);
+    while (text.length() + length <= bytes)
+        text += character;
+    text.append(bytes - text.length(), 'a');
+    return text;
+}
+
+// Keeps the compiler from dropping the conversions
+static volatile wchar_t sink;
+
+template<typename Convert>
+static void BenchmarkConversion(const char* name, const std::string& text, Convert convert) {
+    long rounds = 20000000 / (long)(text.length() + 16);
+    double start = Now();
+    for (long round = 0; round < rounds; round++) {
+        wchar_t* converted = convert(text);
+        sink = converted[0];
+        delete[] converted;
+    }
+    Report(name, "bytes", (long)text.length(), rounds, Now() - start);
+}
+
+static void BenchmarkUtf8() {
+    // Mostly ASCII like most dialogs, accented Latin (2 bytes), CJK (3 bytes), emoji (4 bytes, surrogate pairs)
+    static const struct {
+        const char* name;
+        const char* character;
+    } alphabets[] = {
+        { "ascii", "Save the file? " },
+        { "latin", "\xC3\xA9t\xC3\xA9 " },
+        { "cjk", "\xE6\x96\x87\xE5\xAD\x97" },
+        { "emoji", "\xF0\x9F\x98\x80" }
+    };
+    static const size_t sizes[] = { 16, 256, 4096 };
+
+    char name[64];
+    for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); a++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            std::string text = MakeText(alphabets[a].character, sizes[s]);
+            snprintf(name, sizeof(name), "utf8/%s/ToUtf16", alphabets[a].name);
+            if (Enabled(name))
+                BenchmarkConversion(name, text, ConvertWithUtf8);
+            snprintf(name, sizeof(name), "utf8/%s/codecvt", alphabets[a].name);
+            if (Enabled(name))
+                BenchmarkConversion(name, text, ConvertWithCodecvt);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Initialize(argc, argv);
+    BenchmarkUtf8();
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Throughput and latency of the events, from headless dialogs to the JS listeners.
+// Each result is printed as a JSON object on its own line, like EventPipelineBench:
+//
+//     node bench/events.js [seconds]
+//
+// runs every combination of delivery mode and number of dialogs in a fresh process,
+// since the statistics of TaskDialog.GetStats cover the whole process.
+// The `results` mode measures whole shows instead: each dialog is closed as soon as possible and shown again,
+// which builds a `loaded` event object and a result object per show.
+var TaskDialog = require('../'),
+    spawnSync = require('child_process').spawnSync,
+
+    dialogCounts = [ 1, 8, 64 ],
+    modes = [ 'batch', 'single', 'results' ];
+
+function runResults(dialogs, seconds) {
+    var shows = 0,
+        running = dialogs,
+        start = Date.now();
+
+    TaskDialog.SetHeadless({ CloseAfter: 1 });
+
+    function show(td) {
+        td.Show(function () {
+            shows++;
+            if (Date.now() - start < seconds * 1000)
+                return show(td);
+            if (--running === 0) {
+                console.log(JSON.stringify({
+                    benchmark: 'events/results',
+                    dialogs: dialogs,
+                    shows: shows,
+                    showsPerSecond: Math.round(shows / ((Date.now() - start) / 1000))
+                }));
+            }
+        });
+    }
+    for (var i = 0; i < dialogs; i++) {
+        var td = new TaskDialog({ MainInstruction: 'Dialog ' + i });
+        td.on('loaded', function () {});
+        show(td);
+    }
+}
+
+function run(mode, dialogs, seconds) {
+    var received = 0,
+        closed = 0,
+        start = Date.now();
+
+    // Ticks as often as the platform allows, and closes every dialog at the end of the run
+    TaskDialog.SetHeadless({ TimerInterval: 1, CloseAfter: seconds * 1000 });
+
+    for (var i = 0; i < dialogs; i++) {
+        var td = new TaskDialog({ MainInstruction: 'Dialog ' + i, UseTimer: true });
+        td._native.BatchEvents = mode === 'batch';
+        td.on('timer', function () {
+            received++;
+        });
+        td.Show(function () {
+            if (++closed < dialogs)
+                return;
+            var elapsed = (Date.now() - start) / 1000,
+                stats = TaskDialog.GetStats(),
+                timer = stats.Events.timer || { QueueLatency: {}, DispatchLatency: {} };
+            console.log(JSON.stringify({
+                benchmark: 'events/' + mode,
+                dialogs: dialogs,
+                events: received,
+                eventsPerSecond: Math.round(received / elapsed),
+                queueP50: timer.QueueLatency.P50,
+                queueP99: timer.QueueLatency.P99,
+                dispatchP50: timer.DispatchLatency.P50,
+                dispatchP99: timer.DispatchLatency.P99,
+                droppedEvents: stats.DroppedEvents
+            }));
+        });
+    }
+}
+
+if (process.argv[2] === '--run') {
+    if (process.argv[3] === 'results')
+        runResults(+process.argv[4], +process.argv[5]);
+    else
+        run(process.argv[3], +process.argv[4], +process.argv[5]);
+} else {
+    var seconds = +process.argv[2] || 5;
+    modes.forEach(function (mode) {
+        dialogCounts.forEach(function (dialogs) {
+            spawnSync(process.execPath, [ __filename, '--run', mode, dialogs, seconds ], { stdio: 'inherit' });
+        });
+    });
+}
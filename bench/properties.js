@@ -0,0 +1,104 @@
+// Cost of setting up dialogs from JS, on hidden dialogs.
+// Each result is printed as a JSON object on its own line, like EventPipelineBench:
+//
+//     node bench/properties.js [filter]
+//
+// runs the benchmarks whose name contains `filter` (all of them by default).
+var TaskDialog = require('../'),
+
+    filter = process.argv[2] || '',
+    benchmarks = [];
+
+// Runs `fn(i)` for `operations` iterations, after a warm-up, and prints the time per iteration
+function measure(name, parameter, value, operations, fn) {
+    if (name.indexOf(filter) === -1)
+        return;
+    for (var i = 0; i < Math.min(operations, 1000); i++)
+        fn(i);
+    var start = process.hrtime();
+    for (i = 0; i < operations; i++)
+        fn(i);
+    var elapsed = process.hrtime(start),
+        result = { benchmark: name };
+    result[parameter] = value;
+    result.operations = operations;
+    result.nsPerOp = Math.round((elapsed[0] * 1e9 + elapsed[1]) / operations * 10) / 10;
+    console.log(JSON.stringify(result));
+}
+
+function text(length, i) {
+    var unit = 'Lorem ipsum dolor sit amet, ' + i + ' ';
+    return new Array(Math.ceil(length / unit.length) + 1).join(unit).slice(0, length);
+}
+
+// A string property set to a new value each time, from a short title to a large log in ExpandedInformation.
+// The characters are copied once, with no transcoding.
+benchmarks.push(function () {
+    [ 16, 1024, 65536 ].forEach(function (length) {
+        var td = new TaskDialog(),
+            values = [ text(length, 0), text(length, 1) ];
+        measure('properties/string', 'length', length, length > 1024 ? 20000 : 200000, function (i) {
+            td.ExpandedInformation = values[i & 1];
+        });
+    });
+});
+
+// A dialog created with a full configuration, sent to the native side in a single SetProperties call,
+// compared with the same properties set one by one
+var config = {
+    WindowTitle: 'Copy files',
+    MainInstruction: 'Copying 1200 files',
+    Content: 'From C:\\Projects to D:\\Backup',
+    ExpandedInformation: 'Started at 10:42',
+    Footer: 'Estimated time left: 2 minutes',
+    MainIcon: 'information',
+    UseProgressBar: true,
+    ProgressBarPosition: 25,
+    Cancelable: true,
+    UseTimer: true
+};
+benchmarks.push(function () {
+    var names = Object.keys(config);
+    measure('properties/create', 'properties', names.length, 50000, function () {
+        new TaskDialog(config);
+    });
+    measure('properties/createOneByOne', 'properties', names.length, 50000, function () {
+        var td = new TaskDialog();
+        for (var i = 0; i < names.length; i++)
+            td[names[i]] = config[names[i]];
+    });
+});
+
+// Reads and writes through the native accessors, with values that change every time
+benchmarks.push(function () {
+    var td = new TaskDialog(config),
+        sink = 0;
+    measure('properties/get', 'properties', 3, 1000000, function () {
+        sink += td.ProgressBarPosition + td.Content.length + (td.Cancelable ? 1 : 0);
+    });
+    measure('properties/set', 'properties', 3, 1000000, function (i) {
+        td.ProgressBarPosition = i % 101;
+        td.Cancelable = (i & 1) === 0;
+        td.UpdateInterval = 16 + (i & 7);
+    });
+    return sink;
+});
+
+// Buttons sent again before each show with a single caption changed, as done by Show and Navigate
+benchmarks.push(function () {
+    [ 10, 100, 500 ].forEach(function (count) {
+        var td = new TaskDialog(),
+            buttons = [];
+        for (var i = 0; i < count; i++)
+            buttons.push([ 'button' + i, 'Button ' + i ]);
+        measure('properties/buttons', 'buttons', count, count > 100 ? 20000 : 100000, function (i) {
+            buttons[i % count] = [ 'button' + (i % count), 'Button ' + i ];
+            td._native.SetProperties({ Buttons: buttons });
+        });
+    });
+});
+
+console.log(JSON.stringify({ node: process.version }));
+benchmarks.forEach(function (benchmark) {
+    benchmark();
+});
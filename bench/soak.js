@@ -0,0 +1,121 @@
+// Soak test: keeps `dialogs` headless dialogs open for `seconds`, and samples the load of the process every second.
+// Each sample is printed as a JSON object on its own line, like EventPipelineBench:
+//
+//     node bench/soak.js [dialogs] [seconds] [timerInterval] [shared]
+//
+// `dialogs` can be a list, such as `10,100,500` (the default), to draw how the process scales:
+// each count then runs in a fresh process, since the statistics of TaskDialog.GetStats cover the whole process.
+// Every dialog ticks every `timerInterval` milliseconds (10 by default) and updates its progress bar and content
+// on each tick, gets its first button clicked every second, and is canceled after 5 seconds, then shown again.
+// `shared` hosts all the dialogs on the shared UI thread. Memory, threads and latencies should level off:
+// `rssGrowth` in the last line compares the end of the run with its first sample.
+var TaskDialog = require('../'),
+    spawnSync = require('child_process').spawnSync,
+
+    dialogCounts = (process.argv[2] || '10,100,500').split(',').map(Number),
+    dialogs = dialogCounts[0],
+    seconds = +process.argv[3] || 30,
+    timerInterval = +process.argv[4] || 10,
+    shared = process.argv[5] === 'shared',
+
+    start = Date.now(),
+    shows = 0,
+    ticks = 0,
+    clicks = 0,
+    open = 0,
+    samples = [];
+
+function percentile(histogram, name) {
+    return histogram ? histogram[name] : undefined;
+}
+
+function sample() {
+    var stats = TaskDialog.GetStats(),
+        memory = process.memoryUsage(),
+        timer = stats.Events.timer || {},
+        result = {
+            benchmark: 'soak',
+            dialogs: dialogs,
+            elapsed: Math.round((Date.now() - start) / 1000),
+            open: open,
+            shows: shows,
+            ticks: ticks,
+            clicks: clicks,
+            threads: stats.Threads,
+            idleThreads: stats.IdleThreads,
+            waitingDialogs: stats.WaitingDialogs,
+            queuedEvents: stats.QueuedEvents,
+            queueHighWater: stats.QueueHighWater,
+            droppedEvents: stats.DroppedEvents,
+            overflowEvents: stats.OverflowEvents,
+            timerQueueP99: percentile(timer.QueueLatency, 'P99'),
+            timerDispatchP99: percentile(timer.DispatchLatency, 'P99'),
+            rss: memory.rss,
+            heapUsed: memory.heapUsed
+        };
+    samples.push(result);
+    console.log(JSON.stringify(result));
+}
+
+function show(td) {
+    open++;
+    shows++;
+    td.Show(function () {
+        open--;
+        if (Date.now() - start < seconds * 1000)
+            return show(td);
+        if (open === 0)
+            finish();
+    });
+}
+
+function finish() {
+    clearInterval(sampler);
+    sample();
+    var first = samples[0],
+        last = samples[samples.length - 1];
+    console.log(JSON.stringify({
+        benchmark: 'soak/summary',
+        dialogs: dialogs,
+        seconds: seconds,
+        shared: shared,
+        shows: shows,
+        ticksPerSecond: Math.round(ticks / ((Date.now() - start) / 1000)),
+        maxThreads: Math.max.apply(null, samples.map(function (s) { return s.threads; })),
+        rssGrowth: last.rss - first.rss,
+        heapUsedGrowth: last.heapUsed - first.heapUsed
+    }));
+}
+
+function run() {
+    TaskDialog.SetSharedUIThread(shared);
+    TaskDialog.SetHeadless({ TimerInterval: timerInterval, ClickInterval: 1000, ClickButton: 0, CloseAfter: 5000 });
+
+    for (var i = 0; i < dialogs; i++) {
+        var td = new TaskDialog({
+            MainInstruction: 'Dialog ' + i,
+            Buttons: [ [ 'again', 'Again', true ] ],
+            UseTimer: true,
+            UseProgressBar: true
+        });
+        td.on('timer', function (e) {
+            ticks++;
+            this.ProgressBarPosition = Math.floor(e.data / 50) % 101;
+            this.Content = 'Elapsed: ' + e.data + ' ms';
+        });
+        td.on('click:button', function () {
+            clicks++;
+        });
+        show(td);
+    }
+    return setInterval(sample, 1000);
+}
+
+var sampler;
+if (dialogCounts.length === 1) {
+    sampler = run();
+} else {
+    dialogCounts.forEach(function (count) {
+        spawnSync(process.execPath, [ __filename, count, seconds, timerInterval, shared ? 'shared' : '' ], { stdio: 'inherit' });
+    });
+}
@@ -0,0 +1,41 @@
+// Cost, on the main thread, of changing a visible headless dialog, and how many of the changes reach it.
+// Each result is printed as a JSON object on its own line, like EventPipelineBench:
+//
+//     node bench/updates.js [writes]
+//
+// `WindowTitle` goes through the ordered command queue, the other properties are write-combined.
+var TaskDialog = require('../'),
+
+    writes = +process.argv[2] || 100000,
+    properties = [ 'WindowTitle', 'Content', 'ProgressBarPosition' ];
+
+function value(property, i) {
+    return property === 'ProgressBarPosition' ? i % 101 : property + ' ' + i;
+}
+
+function bench(property, done) {
+    var td = new TaskDialog({ MainInstruction: 'Updates', UseProgressBar: true });
+
+    td.on('loaded', function () {
+        var start = process.hrtime();
+        for (var i = 0; i < writes; i++)
+            td[property] = value(property, i);
+        var elapsed = process.hrtime(start);
+
+        console.log(JSON.stringify({
+            benchmark: 'updates/' + property,
+            operations: writes,
+            nsPerOp: Math.round((elapsed[0] * 1e9 + elapsed[1]) / writes * 10) / 10,
+            elidedUpdates: td.ElidedUpdates,
+            unchangedUpdates: td.UnchangedUpdates
+        }));
+    });
+    td.Show(done);
+}
+
+// Each dialog is cancelled a second after being shown, once its updates have been flushed
+TaskDialog.SetHeadless({ CloseAfter: 1000 });
+(function next(i) {
+    if (i < properties.length)
+        bench(properties[i], function () { next(i + 1); });
+})(0);
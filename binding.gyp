@@ -1,13 +1,134 @@
 {
-    "targets": [
-        {
-           "target_name": "TaskDialog",
-            "sources": [
-                "src/node.cpp"
-            ],
-            "libraries": [
-                "-lcomctl32.lib"
+    "variables": {
+        "build_tests%": 0
+    },
+    "target_defaults": {
+        "include_dirs": [
+            "src"
+        ],
+        "conditions": [
+            [ "OS!='win'", {
+                "ldflags": [
+                    "-pthread"
+                ]
+            } ]
+        ]
+    },
+    "conditions": [
+        [ "build_tests==1 or OS!='win'", {
+            "targets": [
+                {
+                    "target_name": "AsyncEventQueueTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/AsyncEventQueueTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "Utf8Test",
+                    "type": "executable",
+                    "sources": [
+                        "test/Utf8Test.cpp"
+                    ]
+                },
+                {
+                    "target_name": "Utf8ScalarTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/Utf8Test.cpp"
+                    ],
+                    "defines": [
+                        "UTF8_NO_SSE2"
+                    ]
+                },
+                {
+                    "target_name": "StringArenaTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/StringArenaTest.cpp"
+                    ],
+                    "cflags_cc!": [
+                        "-fno-exceptions"
+                    ],
+                    "msvs_settings": {
+                        "VCCLCompilerTool": {
+                            "ExceptionHandling": 1
+                        }
+                    },
+                    "xcode_settings": {
+                        "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+                    }
+                },
+                {
+                    "target_name": "HeadlessBackendTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/HeadlessBackendTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "DialogWorkerPoolTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/DialogWorkerPoolTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "LatencyHistogramTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/LatencyHistogramTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "EventPipelineTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/EventPipelineTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "UpdatePipelineTest",
+                    "type": "executable",
+                    "sources": [
+                        "test/UpdatePipelineTest.cpp"
+                    ]
+                },
+                {
+                    "target_name": "EventPipelineBench",
+                    "type": "executable",
+                    "sources": [
+                        "bench/EventPipelineBench.cpp"
+                    ]
+                },
+                {
+                    "target_name": "StringsBench",
+                    "type": "executable",
+                    "sources": [
+                        "bench/StringsBench.cpp"
+                    ]
+                },
+                {
+                    "target_name": "HeadlessBench",
+                    "type": "executable",
+                    "sources": [
+                        "bench/HeadlessBench.cpp"
+                    ]
+                }
             ]
-        }
+        } ],
+        [ "OS=='win'", {
+            "targets": [
+                {
+                   "target_name": "TaskDialog",
+                    "sources": [
+                        "src/node.cpp"
+                    ],
+                    "libraries": [
+                        "-lcomctl32.lib"
+                    ]
+                }
+            ]
+        } ]
     ]
-}
\ No newline at end of file
+}
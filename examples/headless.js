@@ -0,0 +1,28 @@
+var TaskDialog = require('../'),
+    td = new TaskDialog({
+        WindowTitle: 'Headless example',
+        MainInstruction: 'Nobody will see this',
+        Buttons: [
+            [ 'again', 'Again', true ],
+            [ 'done', 'Done' ]
+        ],
+        UseTimer: true
+    }),
+    clicks = 0;
+
+// Raises a timer event every 10 milliseconds, clicks the first button every 50 milliseconds,
+// and cancels the dialog after one second
+TaskDialog.SetHeadless({ TimerInterval: 10, ClickInterval: 50, ClickButton: 0, CloseAfter: 1000 });
+
+td.on('timer', function (e) {
+    td.Content = 'Elapsed: ' + e.data + ' ms';
+});
+
+td.on('click:button', function (e) {
+    if (e.data === 'again')
+        clicks++;
+});
+
+td.Show(function (res) {
+    console.log('Closed with ' + res.button + ' after ' + clicks + ' clicks');
+});
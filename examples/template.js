@@ -0,0 +1,19 @@
+var TaskDialog = require('../'),
+    notification = TaskDialog.template({
+        WindowTitle: 'Template example',
+        MainInstruction: 'New message',
+        MainIcon: 'info',
+        Buttons: [
+            [ 'read', 'Read it' ],
+            [ 'later', 'Later' ]
+        ]
+    }),
+    senders = [ 'Alice', 'Bob', 'Carol' ];
+
+TaskDialog.SetSharedUIThread(true);
+
+senders.forEach(function (sender) {
+    notification.Show({ Content: 'You have a new message from ' + sender }, function (res) {
+        console.log(sender + ': ' + res.button);
+    });
+});
@@ -2,24 +2,8 @@ var TaskDialogNative = require('./build/Release/TaskDialog'),
     EventEmitter = require('events').EventEmitter,
     util = require('util'),
 
-    ICONS = {
-        'none': 0,
-        'warning': -1,
-        'error': -2,
-        'info': -3,
-        'shield': -4
-    },
-
-    STANDARD_BUTTONS = {
-        1: 'ok',
-        2: 'cancel'
-    },
-
-    PROGRESSBAR_STATE = {
-        'normal' : 1,
-        'error': 2,
-        'paused': 3
-    };
+    // Properties wrapped by `wrapNativeProperty`, by name
+    nativeProperties = {};
 
 // Helper function to define an hidden property (non enumerable, non configurable, but writable)
 function defineHiddenProperty(obj, name, value) {
@@ -34,30 +18,61 @@ function defineHiddenProperty(obj, name, value) {
         });
 }
 
-// Helper function to wrap a native Set* method in a property-like interface
-function wrapNativeMethod(prop, beforeSet, canNativeSet) {
+// Helper function to expose a property of the native object.
+// The native side checks and converts the value, applies it to the dialog and keeps it for the getter.
+function wrapNativeProperty(prop) {
+    nativeProperties[prop] = true;
     Object.defineProperty(TaskDialog.prototype, prop, {
         configurable: false,
         enumerable: true,
         get: function () {
-            return this['_' + prop];
+            return this._native[prop];
         },
         set: function (val) {
-            if (beforeSet)
-                val = beforeSet.call(this, val);
-            if (!isPropSet(this, prop))
-                defineHiddenProperty(this, '_' + prop, val);
-            else
-                this['_' + prop] = val;
-            if (!canNativeSet || canNativeSet.call(this))
-                this._native['Set' + prop](val);
+            this._native[prop] = val;
         }
     });
 }
 
-// Helper function to check if a native property has been set
-function isPropSet(obj, prop) {
-    return Object.prototype.hasOwnProperty.call(obj, '_' + prop);
+// Helper function to set many properties at once.
+// Native properties are sent to the native object with a single call.
+function setProperties(obj, values) {
+    var native = {};
+    for (var k in values) {
+        if (nativeProperties.hasOwnProperty(k))
+            native[k] = values[k];
+        else
+            obj[k] = values[k];
+    }
+    obj._native.SetProperties(native);
+}
+
+// Helper function to send the buttons to the native side.
+// Frozen arrays (like the ones of a template) cannot change, so they are sent only once.
+function syncButtons(dialog) {
+    var buttons = dialog.Buttons || [],
+        radioButtons = dialog.RadioButtons || [],
+        native = {};
+    if (buttons !== dialog._nativeButtons || !Object.isFrozen(buttons))
+        native.Buttons = buttons;
+    if (radioButtons !== dialog._nativeRadioButtons || !Object.isFrozen(radioButtons))
+        native.RadioButtons = radioButtons;
+    if (!native.Buttons && !native.RadioButtons)
+        return;
+
+    // Remembered only once accepted, so that an invalid array is checked again next time
+    dialog._native.SetProperties(native);
+    if (native.Buttons)
+        defineHiddenProperty(dialog, '_nativeButtons', buttons);
+    if (native.RadioButtons)
+        defineHiddenProperty(dialog, '_nativeRadioButtons', radioButtons);
+}
+
+// Helper function to make an immutable copy of a buttons array
+function freezeButtons(buttons) {
+    return Object.freeze((buttons || []).map(function (button) {
+        return Object.freeze(button.slice());
+    }));
 }
 
 // TaskDialog class
@@ -66,28 +81,38 @@ function TaskDialog(config) {
     // EventEmitter constructor
     EventEmitter.call(this);
 
-    // Hidden property to store the native object
-    defineHiddenProperty(this, '_native', new TaskDialogNative(function (eventName, eventData) {
-
-        // Before passing the events to the user, we need to adjust the results
-        // translating native IDs to meaningful data
-        switch(eventName) {
-            case 'click:button':
-                if (eventData.data > 1000) // Removes the increment of 1000 for message-only buttons
-                    eventData.data -= 1000;
-                if (eventData.data >= 101)
-                    eventData.data = this.Buttons[eventData.data - 101][0];
-                if (eventData.data in STANDARD_BUTTONS)
-                    eventData.data = STANDARD_BUTTONS[eventData.data];
-                break;
-            case 'click:radio':
-                if (eventData.data >= 101)
-                    eventData.data = this.RadioButtons[eventData.data - 101][0];
-                break;
+    // Hidden property to store the native object.
+    // Events are delivered in batches: the native side calls back once per wakeup
+    // with an array of alternating event names and event objects.
+    // Button ids are already translated to the values of the buttons.
+    // A listener throwing does not prevent the other events of the batch from being emitted:
+    // the first error is rethrown once the batch is done, the next ones right after.
+    defineHiddenProperty(this, '_native', new TaskDialogNative(function (events) {
+        var errors = [];
+        for (var i = 0; i < events.length; i += 2) {
+            try {
+                this.emit(events[i], events[i + 1]);
+            } catch (e) {
+                errors.push(e);
+            }
         }
-        this.emit(eventName, eventData);
-
+        errors.slice(1).forEach(function (e) {
+            process.nextTick(function () { throw e; });
+        });
+        if (errors.length)
+            throw errors[0];
     }.bind(this)));
+    defineHiddenProperty(this._native, '_dialog', this);
+    this._native.BatchEvents = true;
+
+    // The native side raises only the events that have listeners
+    this.on('newListener', function (eventName) {
+        this._native.SetEventSubscribed(eventName, true);
+    });
+    this.on('removeListener', function (eventName) {
+        if (EventEmitter.listenerCount(this, eventName) === 0)
+            this._native.SetEventSubscribed(eventName, false);
+    });
 
     // Collections
     this.Buttons = [];
@@ -95,27 +120,17 @@ function TaskDialog(config) {
 
     // Shortcut properties via constructor
     if(config)
-        for (var k in config)
-            this[k] = config[k];
-
-    // Registers an handler for the `loaded` event to make sure
-    // that properties usable only when the dialog is visible
-    // are re-set to their current value so that a message to the dialog is sent to update the UI
-    this.on('loaded', function () {
-        if (isPropSet(this, 'ProgressBarMarquee'))
-            this.ProgressBarMarquee = this.ProgressBarMarquee;
-        if (isPropSet(this, 'ProgressBarPosition'))
-            this.ProgressBarPosition = this.ProgressBarPosition;
-        if (isPropSet(this, 'ProgressBarState'))
-            this.ProgressBarState = this.ProgressBarState;
-    }.bind(this));
+        setProperties(this, config);
 }
 
 // Inherits EventEmitter
 util.inherits(TaskDialog, EventEmitter);
 
-// Wraps the Set* methods of the native interface in a property-like interface
-var methods = [
+// Exposes the properties of the native object.
+// Icons and progress bar states are given by name, and converted on the native side.
+// Progress bar properties can be set at any time: while the dialog is hidden, their values are kept
+// and applied as soon as it is shown.
+var properties = [
     'WindowTitle',
     'MainInstruction',
     'Content',
@@ -129,46 +144,17 @@ var methods = [
     'UseProgressBar',
     'UseTimer',
     'Cancelable',
-    'Minimizable'
+    'Minimizable',
+    'CoalesceTimer',
+    'UpdateInterval',
+    'MainIcon',
+    'FooterIcon',
+    'ProgressBarMarquee',
+    'ProgressBarPosition',
+    'ProgressBarState'
 ];
-for (var i = 0; i < methods.length; i++)
-    wrapNativeMethod(methods[i]);
-
-// Wraps the Set*Icon methods of the native interface in a property-like interface.
-// This methods should translate icon indexes to a meaningful string,
-// and must enure that the nerby text isn't null, otherwise the app will crash.
-methods = [
-    [ 'MainIcon', 'MainInstruction' ],
-    [ 'FooterIcon', 'Footer' ]
-];
-for (var i = 0; i < methods.length; i++)
-    (function (prop) {
-        wrapNativeMethod(prop[0], function (val) {
-            if (!isPropSet(this, prop[1]))
-                throw new Error('Before setting ' + prop[0] + ', ensure that ' + prop[1] + ' has a value');
-            if (!(val in ICONS))
-                throw new Error('Unknown icon: ' + val);
-            return ICONS[val];
-        });
-    })(methods[i]);
-
-// Wraps the progress bar methods.
-// These methods can be set at any time,
-// but we must ensure that if the dialog isn't visible,
-// the native method must not be called
-wrapNativeMethod('ProgressBarMarquee', null, function () { return this.IsVisible; })
-wrapNativeMethod('ProgressBarPosition', null, function () { return this.IsVisible; });
-wrapNativeMethod(
-    'ProgressBarState',
-    function (val) {
-        if (!(val in PROGRESSBAR_STATE))
-            throw new Error('Unknown state: ' + val);
-        return PROGRESSBAR_STATE[val];
-    },
-    function () {
-        return this.IsVisible;
-    }
-);
+for (var i = 0; i < properties.length; i++)
+    wrapNativeProperty(properties[i]);
 
 // Show method
 TaskDialog.prototype.Show = function (cb) {
@@ -178,36 +164,21 @@ TaskDialog.prototype.Show = function (cb) {
         return;
 
     // Makes sure that buttons are up to date
-    this._native.SetButtons(this.Buttons || []);
-    this._native.SetRadioButtons(this.RadioButtons || []);
+    syncButtons(this);
 
     // Shows the dialog
     this.IsVisible = true;
-    this._native.Show(function (res) {
-
-        // If this is not the final page, the button IDs must refer to the last visible page
-        var finalPage = this;
-        while(finalPage._navigatedTo)
-            finalPage = finalPage._navigatedTo;
+    // The native side gives back the values of the buttons of the last page displayed, and that page
+    this._native.Show(function (res, finalPage) {
 
         // Marks the dialog as not visible anymore
-        finalPage.IsVisible = false;
-
-        // Maps the native results to meaningful data
-        if (res.button > 1000) // Removes the increment of 1000 for message-only buttons
-            res.button -= 1000;
-        if (res.button >= 101)
-            res.button = finalPage.Buttons[res.button - 101][0];
-        if (res.button in STANDARD_BUTTONS)
-            res.button = STANDARD_BUTTONS[res.button];
-        if (res.radio >= 101)
-            res.radio = finalPage.RadioButtons[res.radio - 101][0];
+        finalPage._dialog.IsVisible = false;
 
         // Calls the callback
         if (cb)
             cb(res);
 
-    }.bind(this));
+    });
 
 };
 
@@ -225,19 +196,141 @@ TaskDialog.prototype.Navigate = function (dest) {
         throw new Error("Cannot navigate to a dialog already visible");
 
     // Makes sure that buttons are up to date
-    dest._native.SetButtons(dest.Buttons || []);
-    dest._native.SetRadioButtons(dest.RadioButtons || []);
+    syncButtons(dest);
 
-    // Registers an event on the destination dialog to swap the visibility flags on the `navigated` event
+    // Swaps the visibility flags
     this.IsVisible = false;
     dest.IsVisible = true;
-    defineHiddenProperty(this, '_navigatedTo', dest);
 
     // Navigates to the destination dialog
     this._native.Navigate(dest._native);
 
 };
 
+// Diagnostics: number of timer ticks merged into a later one because of `CoalesceTimer`,
+// or because older events were still waiting to be delivered
+Object.defineProperty(TaskDialog.prototype, 'CoalescedEvents', {
+    configurable: false,
+    enumerable: false,
+    get: function () {
+        return this._native.GetCoalescedEvents();
+    }
+});
+
+// Diagnostics: number of events not raised because nobody was listening to them
+Object.defineProperty(TaskDialog.prototype, 'SuppressedEvents', {
+    configurable: false,
+    enumerable: false,
+    get: function () {
+        return this._native.GetSuppressedEvents();
+    }
+});
+
+// Sets the maximum number of threads hosting the dialogs.
+// Each visible dialog occupies a thread, so when the limit is reached,
+// newly shown dialogs wait for another one to be closed.
+TaskDialog.SetThreadPoolSize = function (size) {
+    TaskDialogNative.SetThreadPoolSize(size);
+};
+
+// Hosts all the dialogs shown from now on in a single UI thread, instead of one thread per dialog
+TaskDialog.SetSharedUIThread = function (shared) {
+    TaskDialogNative.SetSharedUIThread(!!shared);
+};
+
+// Replaces the dialogs shown from now on with invisible ones, to measure or test an application without a user.
+// `options` sets how often (in milliseconds) the dialogs raise their events: `TimerInterval`, `ClickInterval`
+// (clicks on the button at index `ClickButton`), `CloseAfter` (click on Cancel). `false` restores the real dialogs.
+TaskDialog.SetHeadless = function (options) {
+    TaskDialogNative.SetHeadless(options === false ? false : options || {});
+};
+
+// Diagnostics: load of the whole process.
+// Returns an object with the number of `Threads` hosting dialogs (`IdleThreads` of them waiting for a dialog),
+// of `Dialogs` shown and not closed yet (`WaitingDialogs` of them waiting for a thread),
+// of events waiting to be delivered (`QueuedEvents`, at most `QueueHighWater` so far), of timer ticks dropped because
+// too many events were waiting (`DroppedEvents`) and of other events that had to wait in a slower overflow list
+// instead (`OverflowEvents`, never dropped).
+// `Events` holds, for each event raised so far, its `Count` and two latency histograms in microseconds:
+// `QueueLatency` (from the dialog to the main thread) and `DispatchLatency` (from there to the return of the listeners).
+// Each histogram has its `Count`, `Mean`, `P50`, `P99` and `Max`, and lists its non-empty `Buckets` as `[from, count]`
+// pairs; each power of two is split in 16 buckets, so the percentiles are within about 6%.
+TaskDialog.GetStats = function () {
+    return TaskDialogNative.GetStats();
+};
+
+// Diagnostics: writes a timeline of the dialogs and of their events to `path`, which can be opened in
+// Chrome's `chrome://tracing`. `false` stops writing and completes the file.
+TaskDialog.SetTracing = function (path) {
+    TaskDialogNative.SetTracing(path);
+};
+
+// Diagnostics: number of live updates replaced by a newer value before reaching the dialog
+Object.defineProperty(TaskDialog.prototype, 'ElidedUpdates', {
+    configurable: false,
+    enumerable: false,
+    get: function () {
+        return this._native.GetElidedUpdates();
+    }
+});
+
+// Diagnostics: number of property writes skipped because the value was the same as the current one
+Object.defineProperty(TaskDialog.prototype, 'UnchangedUpdates', {
+    configurable: false,
+    enumerable: false,
+    get: function () {
+        return this._native.GetUnchangedUpdates();
+    }
+});
+
+// Immutable dialog template.
+// The configuration is converted once, and all the dialogs created from the template share it:
+// only the properties overridden by a dialog are converted again, and only for that dialog.
+// The dialog holding the configuration is only reachable from `create`: the dialogs created from the template
+// borrow its strings, which must never be changed (or compacted) afterwards.
+function DialogTemplate(config) {
+    var source = new TaskDialog(config);
+    source.Buttons = freezeButtons(source.Buttons);
+    source.RadioButtons = freezeButtons(source.RadioButtons);
+    syncButtons(source);
+
+    // Creates a new dialog from the template, with some properties changed
+    defineHiddenProperty(this, 'create', function (overrides) {
+        return createFromTemplate(source, overrides);
+    });
+    Object.freeze(this);
+}
+
+function createFromTemplate(source, overrides) {
+    var dialog = new TaskDialog();
+
+    // Shares the native configuration and the values of the properties
+    dialog._native.UseTemplate(source._native);
+    dialog.Buttons = source.Buttons;
+    dialog.RadioButtons = source.RadioButtons;
+    defineHiddenProperty(dialog, '_nativeButtons', source.Buttons);
+    defineHiddenProperty(dialog, '_nativeRadioButtons', source.RadioButtons);
+
+    // Properties specific to this dialog
+    if (overrides)
+        setProperties(dialog, overrides);
+
+    return dialog;
+}
+
+// Creates a new dialog from the template and shows it
+DialogTemplate.prototype.Show = function (overrides, cb) {
+    var dialog = this.create(overrides);
+    dialog.Show(cb);
+    return dialog;
+};
+
+Object.freeze(DialogTemplate.prototype);
+
+TaskDialog.template = function (config) {
+    return new DialogTemplate(config);
+};
+
 // Freezes TaskDialog prototype
 Object.freeze(TaskDialog.prototype);
 
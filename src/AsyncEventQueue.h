@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Platform.h"
+
+// ************************************************
+// AsyncEventQueue - Class definition
+// ************************************************
+
+// Bounded lock-free queue with many producers (the dialog threads) and a single consumer (the main thread).
+// Items are stored by value inside a fixed ring of cells, so pushing and popping never touch the heap.
+// Each cell carries a sequence number that tells whether it is free for the producer at a given position,
+// or ready to be read by the consumer (see Dmitry Vyukov's bounded MPMC queue).
+// `Capacity` must be a power of two.
+template<typename T, LONG Capacity>
+class AsyncEventQueue {
+
+    public:
+
+        AsyncEventQueue();
+
+        // Can be called from any thread. Returns false if the queue is full.
+        bool Push(const T& item);
+
+        // Must be called only from the consumer thread. Returns false if the queue is empty.
+        bool Pop(T& item);
+
+        // Must be called only from the consumer thread.
+        // Items being pushed at the same time may or may not be counted.
+        LONG GetSize() const;
+
+    private:
+
+        // The sequence number is read with acquire semantics and written with release semantics,
+        // so a consumer that observes the new sequence number also observes the data written before it.
+        struct Cell {
+            volatile LONG sequence;
+            T data;
+        };
+
+        Cell _cells[Capacity];
+        volatile LONG _enqueuePosition;
+        LONG _dequeuePosition;
+
+        // Non copyable
+        AsyncEventQueue(const AsyncEventQueue&);
+        AsyncEventQueue& operator=(const AsyncEventQueue&);
+};
+
+// ************************************************
+// AsyncEventQueue - Implementation
+// ************************************************
+
+template<typename T, LONG Capacity>
+AsyncEventQueue<T, Capacity>::AsyncEventQueue() :
+    _enqueuePosition(0),
+    _dequeuePosition(0)
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    for (LONG i = 0; i < Capacity; i++)
+        _cells[i].sequence = i;
+}
+
+template<typename T, LONG Capacity>
+bool AsyncEventQueue<T, Capacity>::Push(const T& item) {
+    Cell* cell;
+    LONG position = LoadAcquire(_enqueuePosition);
+
+    // Reserves a cell by moving the enqueue position forward
+    for (;;) {
+        cell = &_cells[position & (Capacity - 1)];
+        LONG diff = (LONG)((ULONG)LoadAcquire(cell->sequence) - (ULONG)position);
+        if (diff == 0) {
+            if (InterlockedCompareExchange(&_enqueuePosition, position + 1, position) == position)
+                break;
+            position = LoadAcquire(_enqueuePosition);
+        } else if (diff < 0) {
+            return false; // The consumer has not released this cell yet: the queue is full
+        } else {
+            position = LoadAcquire(_enqueuePosition); // Another producer took this cell
+        }
+    }
+
+    // Publishes the item to the consumer
+    cell->data = item;
+    StoreRelease(cell->sequence, position + 1);
+    return true;
+}
+
+template<typename T, LONG Capacity>
+bool AsyncEventQueue<T, Capacity>::Pop(T& item) {
+    Cell* cell = &_cells[_dequeuePosition & (Capacity - 1)];
+    LONG diff = (LONG)((ULONG)LoadAcquire(cell->sequence) - (ULONG)(_dequeuePosition + 1));
+    if (diff < 0)
+        return false;
+
+    // Reads the item and gives the cell back to the producers for the next lap
+    item = cell->data;
+    StoreRelease(cell->sequence, _dequeuePosition + Capacity);
+    _dequeuePosition++;
+    return true;
+}
+
+template<typename T, LONG Capacity>
+LONG AsyncEventQueue<T, Capacity>::GetSize() const {
+    return (LONG)((ULONG)LoadAcquire(_enqueuePosition) - (ULONG)_dequeuePosition);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Platform.h"
+
+// ************************************************
+// DialogBackend - Class definition
+// ************************************************
+
+// Displays the dialogs.
+// A backend behaves like `TaskDialogIndirect`: it runs a modal loop until the dialog is closed,
+// sends the TDN_* notifications to `config->pfCallback`, and accepts the TDM_* messages sent to the handle
+// passed to the callback. Kerr::TaskDialog only talks to a dialog through the backend that shows it,
+// so that a backend is free to use something else than a window.
+class DialogBackend {
+
+    public:
+
+        // Receives the messages of a dialog before the dialog does, on the dialog thread.
+        // Returns true if it handled the message, after setting `result`.
+        typedef bool (*MessageHook)(HWND handle, UINT message, WPARAM wParam, LPARAM lParam, DWORD_PTR data, LRESULT* result);
+
+        virtual ~DialogBackend() {}
+
+        virtual HRESULT ShowDialog(const TASKDIALOGCONFIG* config, int* button, int* radioButton, BOOL* verificationChecked) = 0;
+
+        // Can be called from any thread, like SendMessage and PostMessage.
+        // A message sent from another thread waits for the dialog thread to handle it.
+        // Once the dialog is closed, messages are dropped and sending returns 0.
+        virtual LRESULT SendDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0) = 0;
+        virtual BOOL PostDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0) = 0;
+
+        // Must be called from the dialog thread.
+        // A timer sends WM_TIMER, with its id as wParam, every `milliseconds` until it is killed.
+        virtual void SetDialogTimer(HWND handle, UINT_PTR id, UINT milliseconds) = 0;
+        virtual void KillDialogTimer(HWND handle, UINT_PTR id) = 0;
+        virtual BOOL SetDialogHook(HWND handle, MessageHook hook, DWORD_PTR data) = 0;
+        virtual void RemoveDialogHook(HWND handle, MessageHook hook) = 0;
+};
+
+#if defined _WIN32
+
+// ************************************************
+// Comctl32Backend - Class definition
+// ************************************************
+
+// Real dialogs, shown by comctl32. The hooks are window subclasses.
+class Comctl32Backend : public DialogBackend {
+
+    public:
+
+        HRESULT ShowDialog(const TASKDIALOGCONFIG* config, int* button, int* radioButton, BOOL* verificationChecked);
+
+        LRESULT SendDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0);
+        BOOL PostDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0);
+
+        void SetDialogTimer(HWND handle, UINT_PTR id, UINT milliseconds);
+        void KillDialogTimer(HWND handle, UINT_PTR id);
+        BOOL SetDialogHook(HWND handle, MessageHook hook, DWORD_PTR data);
+        void RemoveDialogHook(HWND handle, MessageHook hook);
+
+    private:
+
+        static LRESULT CALLBACK SubclassProc(HWND handle, UINT message, WPARAM wParam, LPARAM lParam, UINT_PTR id, DWORD_PTR data);
+};
+
+// ************************************************
+// Comctl32Backend - Implementation
+// ************************************************
+
+HRESULT Comctl32Backend::ShowDialog(const TASKDIALOGCONFIG* config, int* button, int* radioButton, BOOL* verificationChecked) {
+    return ::TaskDialogIndirect(config, button, radioButton, verificationChecked);
+}
+
+LRESULT Comctl32Backend::SendDialogMessage(HWND handle, UINT message, WPARAM wParam, LPARAM lParam) {
+    return ::SendMessageW(handle, message, wParam, lParam);
+}
+
+BOOL Comctl32Backend::PostDialogMessage(HWND handle, UINT message, WPARAM wParam, LPARAM lParam) {
+    return ::PostMessageW(handle, message, wParam, lParam);
+}
+
+void Comctl32Backend::SetDialogTimer(HWND handle, UINT_PTR id, UINT milliseconds) {
+    ::SetTimer(handle, id, milliseconds, NULL);
+}
+
+void Comctl32Backend::KillDialogTimer(HWND handle, UINT_PTR id) {
+    ::KillTimer(handle, id);
+}
+
+// The hook is also the id of the subclass
+BOOL Comctl32Backend::SetDialogHook(HWND handle, MessageHook hook, DWORD_PTR data) {
+    return ::SetWindowSubclass(handle, SubclassProc, reinterpret_cast<UINT_PTR>(hook), data);
+}
+
+void Comctl32Backend::RemoveDialogHook(HWND handle, MessageHook hook) {
+    ::RemoveWindowSubclass(handle, SubclassProc, reinterpret_cast<UINT_PTR>(hook));
+}
+
+LRESULT CALLBACK Comctl32Backend::SubclassProc(HWND handle, UINT message, WPARAM wParam, LPARAM lParam, UINT_PTR id, DWORD_PTR data) {
+    LRESULT result = 0;
+    if (reinterpret_cast<MessageHook>(id)(handle, message, wParam, lParam, data, &result))
+        return result;
+    return ::DefSubclassProc(handle, message, wParam, lParam);
+}
+
+#endif
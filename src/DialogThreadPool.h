@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atlbase.h>
+#include <uv.h>
+
+#include "DialogWorkerPool.h"
+#include "TraceLog.h"
+
+// ************************************************
+// DialogThreadPool - Class definition
+// ************************************************
+
+// Load of the pool, for diagnostics
+struct DialogThreadPoolStats {
+    int threads;            // Threads hosting dialogs, including the shared UI thread
+    int idleThreads;        // Pool threads waiting for a dialog
+    int dialogs;            // Dialogs shown and not completed yet
+    int waitingDialogs;     // Dialogs waiting for a thread
+};
+
+// Pool of threads dedicated to hosting modal dialogs.
+// A modal dialog blocks its thread until it is closed, so running dialogs on libuv's threadpool
+// would starve the fs, dns and crypto work of the whole process.
+// The threads are those of a DialogWorkerPool: created lazily and kept alive to be reused by the next dialogs.
+//
+// In shared thread mode, all the dialogs are instead hosted by a single UI thread:
+// the work is posted to a message-only window of that thread, so a dialog shown while others are open
+// runs inside their message loop, and all of them stay responsive.
+// Since modal loops nest, a dialog completes only once all the dialogs shown after it have been closed.
+// Each level of nesting also takes some stack of the UI thread, so past `MaxSharedThreadDepth` dialogs
+// open at once, the next ones go to the pool instead.
+class DialogThreadPool {
+
+    public:
+
+        // Must be called on the main thread
+        static void Initialize();
+        static void SetMaxThreads(int maxThreads);
+        static int GetMaxThreads();
+        static void SetSharedThread(bool shared = true);
+        static void GetStats(DialogThreadPoolStats& stats);
+
+        // Schedules `work` on a pool thread, then `after` on the main thread
+        static void QueueWork(DialogWork* request, DialogWorkCallback work, DialogAfterWorkCallback after);
+
+    private:
+
+        static DialogWorkerPool _workers;
+
+        // Completed requests, shared with the threads of the dialogs
+        static uv_mutex_t _mutex;
+        static DialogWork* _completedHead;
+        static DialogWork* _completedTail;
+
+        // Main thread only
+        static uv_async_t _async;
+        static int _outstandingRequests;
+        static bool _sharedThread;
+
+        // Shared UI thread
+        static const UINT WM_RUN_WORK = WM_APP + 1;
+        static const LONG MaxSharedThreadDepth = 16;
+        static HWND _sharedThreadWindow;
+        static volatile LONG _sharedThreadDepth;
+        static uv_sem_t _sharedThreadReady;
+
+        static void SharedThreadMain(void* arg);
+        static LRESULT CALLBACK SharedThreadWindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+        static void CompleteWork(DialogWork* request);
+        static void AfterWorkHandler(uv_async_t* handle, int status);
+};
+
+// ************************************************
+// DialogThreadPool - Implementation
+// ************************************************
+
+DialogWorkerPool DialogThreadPool::_workers(DialogThreadPool::CompleteWork);
+uv_mutex_t DialogThreadPool::_mutex;
+DialogWork* DialogThreadPool::_completedHead = NULL;
+DialogWork* DialogThreadPool::_completedTail = NULL;
+uv_async_t DialogThreadPool::_async;
+int DialogThreadPool::_outstandingRequests = 0;
+bool DialogThreadPool::_sharedThread = false;
+HWND DialogThreadPool::_sharedThreadWindow = NULL;
+volatile LONG DialogThreadPool::_sharedThreadDepth = 0;
+uv_sem_t DialogThreadPool::_sharedThreadReady;
+
+// Static initialization.
+// The async watcher is referenced only while there are dialogs in the pool.
+void DialogThreadPool::Initialize() {
+    uv_mutex_init(&_mutex);
+    uv_async_init(uv_default_loop(), &_async, DialogThreadPool::AfterWorkHandler);
+    uv_unref((uv_handle_t*)&_async);
+}
+
+void DialogThreadPool::SetMaxThreads(int maxThreads) {
+    _workers.SetMaxThreads(maxThreads);
+}
+
+int DialogThreadPool::GetMaxThreads() {
+    return _workers.GetMaxThreads();
+}
+
+// Dialogs already running keep their thread: only the next ones are affected
+void DialogThreadPool::SetSharedThread(bool shared) {
+    _sharedThread = shared;
+}
+
+void DialogThreadPool::GetStats(DialogThreadPoolStats& stats) {
+    _workers.GetStats(stats.threads, stats.idleThreads, stats.waitingDialogs);
+    if (_sharedThreadWindow)
+        stats.threads++;
+    stats.dialogs = _outstandingRequests;
+}
+
+void DialogThreadPool::QueueWork(DialogWork* request, DialogWorkCallback work, DialogAfterWorkCallback after) {
+    request->work = work;
+    request->after = after;
+    request->next = NULL;
+    request->status = 0;
+    TraceLog::Instant("QueueWork");
+
+    if (_outstandingRequests++ == 0)
+        uv_ref((uv_handle_t*)&_async);
+
+    // Shared thread mode: starts the UI thread the first time, and waits for its window to be ready.
+    // The depth counts the dialogs posted to the UI thread and not completed yet, which are all nested.
+    if (_sharedThread && _sharedThreadDepth < MaxSharedThreadDepth) {
+        if (!_sharedThreadWindow) {
+            uv_thread_t thread;
+            uv_sem_init(&_sharedThreadReady, 0);
+            if (uv_thread_create(&thread, DialogThreadPool::SharedThreadMain, NULL) == 0)
+                uv_sem_wait(&_sharedThreadReady);
+            uv_sem_destroy(&_sharedThreadReady);
+        }
+        if (_sharedThreadWindow) {
+            InterlockedIncrement(&_sharedThreadDepth);
+            if (PostMessageW(_sharedThreadWindow, WM_RUN_WORK, 0, reinterpret_cast<LPARAM>(request)))
+                return;
+            InterlockedDecrement(&_sharedThreadDepth);
+        }
+    }
+    // If the UI thread is not available or already hosts too many dialogs, falls back to the pool
+    _workers.Queue(request);
+}
+
+void DialogThreadPool::SharedThreadMain(void* arg) {
+
+    // Creates the message-only window that receives the work
+    WNDCLASSEXW windowClass = { sizeof(WNDCLASSEXW) };
+    windowClass.lpfnWndProc = DialogThreadPool::SharedThreadWindowProc;
+    windowClass.hInstance = ATL::_AtlBaseModule.GetModuleInstance();
+    windowClass.lpszClassName = L"JSTaskDialogHost";
+    RegisterClassExW(&windowClass);
+    _sharedThreadWindow = CreateWindowExW(0, windowClass.lpszClassName, NULL, 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, windowClass.hInstance, NULL);
+    uv_sem_post(&_sharedThreadReady);
+    if (!_sharedThreadWindow)
+        return;
+
+    // Message loop. While dialogs are open, their own modal loops dispatch the messages of this window.
+    MSG message;
+    while (GetMessageW(&message, NULL, 0, 0) > 0) {
+        TranslateMessage(&message);
+        DispatchMessageW(&message);
+    }
+}
+
+LRESULT CALLBACK DialogThreadPool::SharedThreadWindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
+    if (message != WM_RUN_WORK)
+        return DefWindowProcW(hwnd, message, wParam, lParam);
+
+    DialogWork* request = reinterpret_cast<DialogWork*>(lParam);
+    request->work(request);
+    InterlockedDecrement(&_sharedThreadDepth);
+    CompleteWork(request);
+    return 0;
+}
+
+// Hands a request back to the main thread
+void DialogThreadPool::CompleteWork(DialogWork* request) {
+    uv_mutex_lock(&_mutex);
+        request->next = NULL;
+        if (_completedTail)
+            _completedTail->next = request;
+        else
+            _completedHead = request;
+        _completedTail = request;
+    uv_mutex_unlock(&_mutex);
+    uv_async_send(&_async);
+}
+
+// This function is called on the main thread
+void DialogThreadPool::AfterWorkHandler(uv_async_t* handle, int status) {
+    uv_mutex_lock(&_mutex);
+        DialogWork* request = _completedHead;
+        _completedHead = _completedTail = NULL;
+    uv_mutex_unlock(&_mutex);
+
+    while (request) {
+        DialogWork* next = request->next;
+        request->after(request);
+        request = next;
+
+        if (--_outstandingRequests == 0)
+            uv_unref((uv_handle_t*)&_async);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "Platform.h"
+
+// ************************************************
+// DialogWorkerPool - Class definition
+// ************************************************
+
+struct DialogWork;
+typedef void (*DialogWorkCallback)(DialogWork* request);
+typedef void (*DialogAfterWorkCallback)(DialogWork* request);
+
+// Request for the dialog thread pool, modeled after `uv_work_t`.
+// Only `data` and `status` are meant to be used by the caller:
+// `status` is -1 when `work` could not be run because no thread could be created, 0 otherwise.
+struct DialogWork {
+    void* data;
+    int status;
+    DialogWorkCallback work;
+    DialogAfterWorkCallback after;
+    DialogWork* next;
+};
+
+// Threads dedicated to running the work of DialogThreadPool, which shows modal dialogs.
+// Threads are created lazily, up to a limit, and kept alive to be reused by the next requests:
+// a request waits for a thread only when all of them are busy and no other one can be created.
+// A thread that is woken up for a request stops counting as idle right away, before it actually wakes up,
+// so that requests queued in a row never wait for the same thread while another one could be created.
+// Does not depend on libuv, and runs on every platform. The threads never exit, so a pool must never be destroyed.
+class DialogWorkerPool {
+
+    public:
+
+        // Hands a request back once its work is done, on the thread that ran it,
+        // or with a status of -1 on the thread that queued it if it could not be run
+        typedef void (*CompleteCallback)(DialogWork* request);
+
+        explicit DialogWorkerPool(CompleteCallback complete);
+
+        void SetMaxThreads(int maxThreads);
+        int GetMaxThreads();
+        void GetStats(int& threads, int& idleThreads, int& waitingRequests);
+
+        // Runs `request->work` on a pool thread
+        void Queue(DialogWork* request);
+
+    private:
+
+        CompleteCallback _complete;
+
+        // Guards the rest
+        CRITICAL_SECTION _lock;
+        CONDITION_VARIABLE _workAvailable;
+        DialogWork* _pendingHead;
+        DialogWork* _pendingTail;
+        int _pendingCount;
+        int _threads;
+        int _idleThreads;       // Threads waiting for work, including the ones woken up that are not running yet
+        int _wakeUps;           // Threads woken up that are not running yet
+        int _maxThreads;
+
+        static DWORD CALLBACK ThreadMain(PVOID parameter);
+};
+
+// ************************************************
+// DialogWorkerPool - Implementation
+// ************************************************
+
+DialogWorkerPool::DialogWorkerPool(CompleteCallback complete) :
+    _complete(complete),
+    _pendingHead(NULL),
+    _pendingTail(NULL),
+    _pendingCount(0),
+    _threads(0),
+    _idleThreads(0),
+    _wakeUps(0),
+    _maxThreads(32)
+{
+    InitializeCriticalSection(&_lock);
+    InitializeConditionVariable(&_workAvailable);
+}
+
+void DialogWorkerPool::SetMaxThreads(int maxThreads) {
+    EnterCriticalSection(&_lock);
+        _maxThreads = maxThreads < 1 ? 1 : maxThreads;
+    LeaveCriticalSection(&_lock);
+}
+
+int DialogWorkerPool::GetMaxThreads() {
+    EnterCriticalSection(&_lock);
+        int maxThreads = _maxThreads;
+    LeaveCriticalSection(&_lock);
+    return maxThreads;
+}
+
+void DialogWorkerPool::GetStats(int& threads, int& idleThreads, int& waitingRequests) {
+    EnterCriticalSection(&_lock);
+        threads = _threads;
+        idleThreads = _idleThreads - _wakeUps;
+        waitingRequests = _pendingCount;
+    LeaveCriticalSection(&_lock);
+}
+
+void DialogWorkerPool::Queue(DialogWork* request) {
+    request->next = NULL;
+    DialogWork* failed = NULL;
+
+    EnterCriticalSection(&_lock);
+
+        if (_pendingTail)
+            _pendingTail->next = request;
+        else
+            _pendingHead = request;
+        _pendingTail = request;
+        _pendingCount++;
+
+        // Wakes up an idle thread that no other request has claimed yet, or creates a new one.
+        // When the limit is reached, the request waits for a busy thread to be done.
+        // If no thread can be created and there is none to wait for, the pending requests would never run:
+        // they are completed right away with an error instead.
+        if (_idleThreads > _wakeUps) {
+            _wakeUps++;
+            WakeConditionVariable(&_workAvailable);
+        } else if (_threads < _maxThreads) {
+            HANDLE thread = CreateThread(NULL, 0, DialogWorkerPool::ThreadMain, this, 0, NULL);
+            if (thread) {
+                CloseHandle(thread);
+                _threads++;
+            } else if (_threads == 0) {
+                failed = _pendingHead;
+                _pendingHead = _pendingTail = NULL;
+                _pendingCount = 0;
+            }
+        }
+
+    LeaveCriticalSection(&_lock);
+
+    while (failed) {
+        DialogWork* next = failed->next;
+        failed->status = -1;
+        _complete(failed);
+        failed = next;
+    }
+}
+
+// A thread woken up may find the queue empty, when a busy thread took the request first: it then waits again
+DWORD CALLBACK DialogWorkerPool::ThreadMain(PVOID parameter) {
+    DialogWorkerPool* pool = static_cast<DialogWorkerPool*>(parameter);
+    EnterCriticalSection(&pool->_lock);
+    for (;;) {
+
+        // Waits for some work
+        while (!pool->_pendingHead) {
+            pool->_idleThreads++;
+            while (!pool->_wakeUps)
+                SleepConditionVariableCS(&pool->_workAvailable, &pool->_lock, INFINITE);
+            pool->_wakeUps--;
+            pool->_idleThreads--;
+        }
+        DialogWork* request = pool->_pendingHead;
+        pool->_pendingHead = request->next;
+        if (!pool->_pendingHead)
+            pool->_pendingTail = NULL;
+        pool->_pendingCount--;
+
+        // Runs the dialog without holding the lock
+        LeaveCriticalSection(&pool->_lock);
+            request->work(request);
+            pool->_complete(request);
+        EnterCriticalSection(&pool->_lock);
+
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "AsyncEventQueue.h"
+
+#include <vector>
+
+// ************************************************
+// OverflowEventQueue - Class definition
+// ************************************************
+
+// Events raised by the dialog threads for the main thread: an AsyncEventQueue, and an overflow list for the events
+// that do not fit in it, so that no event is ever lost. Events that can be skipped, such as timer ticks, never go to
+// the list: a newer one follows shortly. Once some events wait in the list, the next ones go there too, so that they
+// are not delivered before them. The dialog threads must never wait for the main thread to do some work (one could
+// be blocked in a `SendMessage` to a dialog), and the main thread holds the lock of the list only to take it whole.
+// Does not depend on V8 nor libuv: JSTaskDialog and the benchmarks share it. Its lock is never deleted, since dialog
+// threads may still raise events while the process exits.
+template<typename T, LONG Capacity>
+class OverflowEventQueue {
+
+    public:
+
+        enum PushResult {
+            Queued,     // In the queue or in the overflow list
+            Skipped,    // A skippable event, while older events wait in the overflow list
+            Dropped     // A skippable event, while the queue is full
+        };
+
+        OverflowEventQueue();
+
+        // Can be called from any thread
+        PushResult Push(const T& event, bool skippable);
+
+        // Called on the main thread only. Passes `deliver` at most `Capacity` events of the queue and then,
+        // if they emptied it, the events of the overflow list. `deliver` may push new events.
+        // Returns the number of events taken from the queue: when it is `Capacity`, more may be waiting.
+        template<typename Deliver>
+        LONG Drain(Deliver deliver);
+
+        LONG GetSize() const;               // Events waiting in the queue
+        LONG GetDroppedEvents() const;
+        LONG GetOverflowEvents() const;     // Events that went to the overflow list
+
+    private:
+
+        AsyncEventQueue<T, Capacity> _queue;
+        CRITICAL_SECTION _overflowLock;
+        std::vector<T> _overflow;
+        volatile LONG _overflowSize;        // Non-zero while the list holds events
+        volatile LONG _overflowEvents;
+        volatile LONG _droppedEvents;
+
+        OverflowEventQueue(const OverflowEventQueue&);
+        OverflowEventQueue& operator=(const OverflowEventQueue&);
+};
+
+// ************************************************
+// LatestValueSlot - Class definition
+// ************************************************
+
+// Latest-wins value of an event: while an event waits to be delivered, newer values only replace the one it will
+// carry, instead of queueing more events. The value is taken when the event is delivered.
+class LatestValueSlot {
+
+    public:
+
+        LatestValueSlot();
+
+        // Stores the value. Returns true if the slot was empty: an event must then be queued to take it.
+        // Otherwise, the event already waiting will carry this value instead of the previous one.
+        bool Set(LONG value);
+
+        // Takes the latest value and empties the slot in the same operation:
+        // a value set afterwards queues a new event, and each value is delivered only once
+        LONG Take();
+
+        // Empties the slot, when the event that would have taken the value could not be queued
+        void Clear();
+
+    private:
+
+        static const LONG Empty = -1;
+
+        volatile LONG _value;
+};
+
+// ************************************************
+// OverflowEventQueue - Implementation
+// ************************************************
+
+template<typename T, LONG Capacity>
+OverflowEventQueue<T, Capacity>::OverflowEventQueue() :
+    _overflowSize(0),
+    _overflowEvents(0),
+    _droppedEvents(0)
+{
+    InitializeCriticalSection(&_overflowLock);
+}
+
+// The state of the list is read once, so that a list emptied meanwhile by the main thread
+// cannot turn a skipped event into a dropped one
+template<typename T, LONG Capacity>
+typename OverflowEventQueue<T, Capacity>::PushResult OverflowEventQueue<T, Capacity>::Push(const T& event, bool skippable) {
+    bool overflowing = LoadAcquire(_overflowSize) != 0;
+    if (!overflowing && _queue.Push(event))
+        return Queued;
+
+    if (skippable) {
+        if (overflowing)
+            return Skipped;
+        InterlockedIncrement(&_droppedEvents);
+        return Dropped;
+    }
+
+    EnterCriticalSection(&_overflowLock);
+        _overflow.push_back(event);
+        InterlockedIncrement(&_overflowSize);
+    LeaveCriticalSection(&_overflowLock);
+    InterlockedIncrement(&_overflowEvents);
+    return Queued;
+}
+
+// The events of the list were raised after the ones that were in the queue,
+// and before the ones queued after the list is taken
+template<typename T, LONG Capacity>
+template<typename Deliver>
+LONG OverflowEventQueue<T, Capacity>::Drain(Deliver deliver) {
+    T event;
+    LONG processed;
+    for (processed = 0; processed < Capacity && _queue.Pop(event); processed++)
+        deliver(event);
+
+    if (processed < Capacity && LoadAcquire(_overflowSize)) {
+        std::vector<T> overflow;
+        EnterCriticalSection(&_overflowLock);
+            overflow.swap(_overflow);
+            InterlockedExchange(&_overflowSize, 0);
+        LeaveCriticalSection(&_overflowLock);
+        for (size_t i = 0; i < overflow.size(); i++)
+            deliver(overflow[i]);
+    }
+    return processed;
+}
+
+template<typename T, LONG Capacity>
+LONG OverflowEventQueue<T, Capacity>::GetSize() const {
+    return _queue.GetSize();
+}
+
+template<typename T, LONG Capacity>
+LONG OverflowEventQueue<T, Capacity>::GetDroppedEvents() const {
+    return _droppedEvents;
+}
+
+template<typename T, LONG Capacity>
+LONG OverflowEventQueue<T, Capacity>::GetOverflowEvents() const {
+    return _overflowEvents;
+}
+
+// ************************************************
+// LatestValueSlot - Implementation
+// ************************************************
+
+LatestValueSlot::LatestValueSlot() :
+    _value(Empty)
+{
+}
+
+bool LatestValueSlot::Set(LONG value) {
+    return InterlockedExchange(&_value, value) == Empty;
+}
+
+LONG LatestValueSlot::Take() {
+    return InterlockedExchange(&_value, Empty);
+}
+
+void LatestValueSlot::Clear() {
+    InterlockedExchange(&_value, Empty);
+}
@@ -0,0 +1,571 @@
+#pragma once
+
+#include "DialogBackend.h"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// ************************************************
+// HeadlessBackend - Class definition
+// ************************************************
+
+// Backend that never shows anything, to measure the rest of the pipeline (events, updates, results)
+// without a user and without drawing. It runs on every platform.
+// Each dialog raises the notifications of a real dialog on a fixed schedule, and keeps the values set by
+// the TDM_* messages in memory instead of drawing them. A dialog is not a window: its handle is a number,
+// and the messages sent or posted to it from other threads wait in a queue of its thread, which the modal
+// loops of that thread serve along with the timers, like Windows does for the windows of a thread.
+// On Windows, the loop also dispatches the window messages of the thread, so that work posted to a thread
+// showing a dialog (such as the nested dialogs of the shared UI thread) still runs.
+// Two threads showing headless dialogs must not send messages to each other's dialogs: unlike SendMessage,
+// a thread waiting for its message to be handled does not serve its own queue meanwhile.
+class HeadlessBackend : public DialogBackend {
+
+    public:
+
+        // Values of a dialog, as set by its configuration and the TDM_* messages
+        struct Model {
+            std::wstring windowTitle;
+            std::wstring texts[TDE_MAIN_INSTRUCTION + 1];
+            int progressPosition;
+            int progressState;
+            LPARAM progressRange;
+            bool progressMarquee;
+            int radioButton;
+            BOOL verificationChecked;
+        };
+
+        HeadlessBackend();
+        ~HeadlessBackend();
+
+        // Schedule of the notifications, in milliseconds. Zero disables an item.
+        // Changes affect the dialogs shown afterwards.
+        void SetTimerInterval(DWORD milliseconds);      // TDN_TIMER, for dialogs using the timer
+        void SetClickInterval(DWORD milliseconds);      // Simulated clicks on a button
+        void SetClickButton(UINT index);                // Index of the button clicked, among the custom ones
+        void SetCloseAfter(DWORD milliseconds);         // Simulated click on Cancel
+
+        HRESULT ShowDialog(const TASKDIALOGCONFIG* config, int* button, int* radioButton, BOOL* verificationChecked);
+
+        LRESULT SendDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0);
+        BOOL PostDialogMessage(HWND handle, UINT message, WPARAM wParam = 0, LPARAM lParam = 0);
+
+        void SetDialogTimer(HWND handle, UINT_PTR id, UINT milliseconds);
+        void KillDialogTimer(HWND handle, UINT_PTR id);
+        BOOL SetDialogHook(HWND handle, MessageHook hook, DWORD_PTR data);
+        void RemoveDialogHook(HWND handle, MessageHook hook);
+
+        // Must be called from the dialog thread. Returns NULL once the dialog is destroyed.
+        const Model* GetModel(HWND handle);
+
+    private:
+
+        // `done` is set once a message sent from another thread has been handled
+        struct Message {
+            HWND handle;
+            UINT message;
+            WPARAM wParam;
+            LPARAM lParam;
+            HANDLE done;
+            LRESULT* result;
+        };
+
+        struct Timer {
+            UINT_PTR id;
+            DWORD interval;
+            DWORD due;
+        };
+
+        struct Hook {
+            MessageHook hook;
+            DWORD_PTR data;
+        };
+
+        struct Dialog;
+
+        // Thread showing dialogs, with the dialogs currently shown from the outermost to the innermost
+        struct Thread {
+            DWORD id;
+            HANDLE wakeUp;
+            std::deque<Message> messages;
+            std::vector<Dialog*> dialogs;
+        };
+
+        struct Dialog {
+            HWND handle;
+            Thread* thread;
+            const TASKDIALOGCONFIG* config;
+            bool closed;
+            int button;
+            DWORD timerStart;
+            UINT clickButton;
+            std::vector<Timer> timers;
+            std::vector<Hook> hooks;
+            Model model;
+        };
+
+        enum TimerId {
+            TimerTick = 1,
+            TimerClick,
+            TimerClose
+        };
+
+        volatile DWORD _timerInterval;
+        volatile DWORD _clickInterval;
+        volatile UINT _clickButton;
+        volatile DWORD _closeAfter;
+
+        // Guards the dialogs, the threads and their queues of messages.
+        // The rest of a dialog belongs to its thread.
+        CRITICAL_SECTION _lock;
+        std::map<HWND, Dialog*> _dialogs;
+        std::map<DWORD, Thread*> _threads;
+        UINT_PTR _lastHandle;
+
+        Dialog* FindDialog(HWND handle);
+        DWORD RunTimers(Thread* thread);
+        bool ProcessMessage(Thread* thread);
+        bool Wait(Thread* thread, DWORD milliseconds);
+        LRESULT Dispatch(Dialog* dialog, UINT message, WPARAM wParam, LPARAM lParam);
+        LRESULT HandleMessage(Dialog* dialog, UINT message, WPARAM wParam, LPARAM lParam);
+
+        static HRESULT Notify(Dialog* dialog, UINT notification, WPARAM wParam = 0, LPARAM lParam = 0);
+        static void Construct(Dialog* dialog, const TASKDIALOGCONFIG* config);
+        static void ClickButton(Dialog* dialog, int buttonId);
+        static void SetText(std::wstring& text, PCWSTR value);
+};
+
+// ************************************************
+// HeadlessBackend - Implementation
+// ************************************************
+
+// The default timer interval is about the one of comctl32
+HeadlessBackend::HeadlessBackend() :
+    _timerInterval(200),
+    _clickInterval(0),
+    _clickButton(0),
+    _closeAfter(0),
+    _lastHandle(0)
+{
+    InitializeCriticalSection(&_lock);
+}
+
+HeadlessBackend::~HeadlessBackend() {
+    DeleteCriticalSection(&_lock);
+}
+
+void HeadlessBackend::SetTimerInterval(DWORD milliseconds) {
+    _timerInterval = milliseconds;
+}
+
+void HeadlessBackend::SetClickInterval(DWORD milliseconds) {
+    _clickInterval = milliseconds;
+}
+
+void HeadlessBackend::SetClickButton(UINT index) {
+    _clickButton = index;
+}
+
+void HeadlessBackend::SetCloseAfter(DWORD milliseconds) {
+    _closeAfter = milliseconds;
+}
+
+HRESULT HeadlessBackend::ShowDialog(const TASKDIALOGCONFIG* config, int* button, int* radioButton, BOOL* verificationChecked) {
+    DWORD threadId = GetCurrentThreadId();
+    Dialog dialog;
+
+    // Registers the dialog, and its thread unless it already shows other dialogs
+    EnterCriticalSection(&_lock);
+    std::map<DWORD, Thread*>::iterator found = _threads.find(threadId);
+    Thread* thread;
+    if (found != _threads.end()) {
+        thread = found->second;
+    } else {
+        thread = new Thread();
+        thread->id = threadId;
+        thread->wakeUp = CreateEventW(NULL, FALSE, FALSE, NULL);
+        _threads[threadId] = thread;
+    }
+    dialog.handle = reinterpret_cast<HWND>(++_lastHandle);
+    dialog.thread = thread;
+    _dialogs[dialog.handle] = &dialog;
+    LeaveCriticalSection(&_lock);
+
+    dialog.closed = false;
+    dialog.button = IDCANCEL;
+    dialog.clickButton = _clickButton;
+    dialog.model.progressPosition = 0;
+    dialog.model.progressState = PBST_NORMAL;
+    dialog.model.progressRange = MAKELPARAM(0, 100);
+    dialog.model.progressMarquee = false;
+    thread->dialogs.push_back(&dialog);
+
+    // Schedules the notifications
+    if (_timerInterval)
+        SetDialogTimer(dialog.handle, TimerTick, _timerInterval);
+    if (_clickInterval)
+        SetDialogTimer(dialog.handle, TimerClick, _clickInterval);
+    if (_closeAfter)
+        SetDialogTimer(dialog.handle, TimerClose, _closeAfter);
+
+    Construct(&dialog, config);
+    Notify(&dialog, TDN_CREATED);
+
+    // Modal loop, serving all the dialogs of the thread
+    while (!dialog.closed) {
+        DWORD wait = RunTimers(thread);
+        if (dialog.closed)
+            break;
+        if (ProcessMessage(thread))
+            continue;
+        if (!Wait(thread, wait))
+            break;
+    }
+
+    Notify(&dialog, TDN_DESTROYED);
+    thread->dialogs.pop_back();
+
+    // Messages still waiting for the dialog are dropped when they come up, or right now if the thread is done
+    EnterCriticalSection(&_lock);
+    _dialogs.erase(dialog.handle);
+    bool threadDone = thread->dialogs.empty();
+    if (threadDone) {
+        _threads.erase(threadId);
+        for (size_t i = 0; i < thread->messages.size(); i++) {
+            if (thread->messages[i].done) {
+                *thread->messages[i].result = 0;
+                SetEvent(thread->messages[i].done);
+            }
+        }
+    }
+    LeaveCriticalSection(&_lock);
+    if (threadDone) {
+        CloseHandle(thread->wakeUp);
+        delete thread;
+    }
+
+    if (button)
+        *button = dialog.button;
+    if (radioButton)
+        *radioButton = dialog.model.radioButton;
+    if (verificationChecked)
+        *verificationChecked = dialog.model.verificationChecked;
+    return S_OK;
+}
+
+LRESULT HeadlessBackend::SendDialogMessage(HWND handle, UINT message, WPARAM wParam, LPARAM lParam) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    if (!dialog) {
+        LeaveCriticalSection(&_lock);
+        return 0;
+    }
+    if (dialog->thread->id == GetCurrentThreadId()) {
+        LeaveCriticalSection(&_lock);
+        return Dispatch(dialog, message, wParam, lParam);
+    }
+
+    // Waits for the dialog thread
+    LRESULT result = 0;
+    Message queued = { handle, message, wParam, lParam, CreateEventW(NULL, FALSE, FALSE, NULL), &result };
+    dialog->thread->messages.push_back(queued);
+    SetEvent(dialog->thread->wakeUp);
+    LeaveCriticalSection(&_lock);
+
+    WaitForSingleObject(queued.done, INFINITE);
+    CloseHandle(queued.done);
+    return result;
+}
+
+BOOL HeadlessBackend::PostDialogMessage(HWND handle, UINT message, WPARAM wParam, LPARAM lParam) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    if (dialog) {
+        Message queued = { handle, message, wParam, lParam, NULL, NULL };
+        dialog->thread->messages.push_back(queued);
+        SetEvent(dialog->thread->wakeUp);
+    }
+    LeaveCriticalSection(&_lock);
+    return dialog ? TRUE : FALSE;
+}
+
+void HeadlessBackend::SetDialogTimer(HWND handle, UINT_PTR id, UINT milliseconds) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    LeaveCriticalSection(&_lock);
+    if (!dialog)
+        return;
+
+    Timer timer = { id, milliseconds, GetTickCount() + milliseconds };
+    for (size_t i = 0; i < dialog->timers.size(); i++) {
+        if (dialog->timers[i].id == id) {
+            dialog->timers[i] = timer;
+            return;
+        }
+    }
+    dialog->timers.push_back(timer);
+}
+
+void HeadlessBackend::KillDialogTimer(HWND handle, UINT_PTR id) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    LeaveCriticalSection(&_lock);
+    if (!dialog)
+        return;
+
+    for (size_t i = 0; i < dialog->timers.size(); i++) {
+        if (dialog->timers[i].id == id) {
+            dialog->timers.erase(dialog->timers.begin() + i);
+            return;
+        }
+    }
+}
+
+BOOL HeadlessBackend::SetDialogHook(HWND handle, MessageHook hook, DWORD_PTR data) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    LeaveCriticalSection(&_lock);
+    if (!dialog)
+        return FALSE;
+
+    // Like a window subclass, the same hook is installed once, with the latest data
+    for (size_t i = 0; i < dialog->hooks.size(); i++) {
+        if (dialog->hooks[i].hook == hook) {
+            dialog->hooks[i].data = data;
+            return TRUE;
+        }
+    }
+    Hook entry = { hook, data };
+    dialog->hooks.push_back(entry);
+    return TRUE;
+}
+
+void HeadlessBackend::RemoveDialogHook(HWND handle, MessageHook hook) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    LeaveCriticalSection(&_lock);
+    if (!dialog)
+        return;
+
+    for (size_t i = 0; i < dialog->hooks.size(); i++) {
+        if (dialog->hooks[i].hook == hook) {
+            dialog->hooks.erase(dialog->hooks.begin() + i);
+            return;
+        }
+    }
+}
+
+const HeadlessBackend::Model* HeadlessBackend::GetModel(HWND handle) {
+    EnterCriticalSection(&_lock);
+    Dialog* dialog = FindDialog(handle);
+    LeaveCriticalSection(&_lock);
+    return dialog ? &dialog->model : NULL;
+}
+
+// Must be called with the lock held
+HeadlessBackend::Dialog* HeadlessBackend::FindDialog(HWND handle) {
+    std::map<HWND, Dialog*>::iterator found = _dialogs.find(handle);
+    return found != _dialogs.end() ? found->second : NULL;
+}
+
+// Fires the timers that are due, and returns how long the loop may wait for the next one
+DWORD HeadlessBackend::RunTimers(Thread* thread) {
+    DWORD wait = INFINITE;
+
+    // A handler may kill timers, or show and close a nested dialog: the vectors are indexed again after each call
+    for (size_t d = 0; d < thread->dialogs.size(); d++) {
+        Dialog* dialog = thread->dialogs[d];
+        for (size_t t = 0; t < dialog->timers.size() && !dialog->closed; t++) {
+            DWORD now = GetTickCount();
+            LONG remaining = static_cast<LONG>(dialog->timers[t].due - now);
+            if (remaining > 0) {
+                if (static_cast<DWORD>(remaining) < wait)
+                    wait = remaining;
+                continue;
+            }
+
+            // Like Windows, a late timer fires once and is scheduled again from now
+            UINT_PTR id = dialog->timers[t].id;
+            dialog->timers[t].due = now + dialog->timers[t].interval;
+            Dispatch(dialog, WM_TIMER, id, 0);
+            wait = 0;
+        }
+    }
+    return wait;
+}
+
+// Handles the next message sent or posted from another thread, if any
+bool HeadlessBackend::ProcessMessage(Thread* thread) {
+    EnterCriticalSection(&_lock);
+    if (thread->messages.empty()) {
+        LeaveCriticalSection(&_lock);
+        return false;
+    }
+    Message message = thread->messages.front();
+    thread->messages.pop_front();
+    Dialog* dialog = FindDialog(message.handle);
+    LeaveCriticalSection(&_lock);
+
+    LRESULT result = dialog ? Dispatch(dialog, message.message, message.wParam, message.lParam) : 0;
+    if (message.done) {
+        *message.result = result;
+        SetEvent(message.done);
+    }
+    return true;
+}
+
+// Waits for a message, a timer or, on Windows, a window message. Returns false on WM_QUIT.
+bool HeadlessBackend::Wait(Thread* thread, DWORD milliseconds) {
+#if defined _WIN32
+    DWORD signaled = MsgWaitForMultipleObjectsEx(1, &thread->wakeUp, milliseconds, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+    if (signaled != WAIT_OBJECT_0 + 1)
+        return true;
+
+    // Like in a real modal loop, a WM_QUIT closes the dialogs and is posted again for the outer loop
+    MSG message;
+    while (PeekMessageW(&message, NULL, 0, 0, PM_REMOVE)) {
+        if (message.message == WM_QUIT) {
+            PostQuitMessage(static_cast<int>(message.wParam));
+            return false;
+        }
+        TranslateMessage(&message);
+        DispatchMessageW(&message);
+    }
+#else
+    WaitForSingleObject(thread->wakeUp, milliseconds);
+#endif
+    return true;
+}
+
+// Gives the message to the hooks, from the latest one, then to the dialog
+LRESULT HeadlessBackend::Dispatch(Dialog* dialog, UINT message, WPARAM wParam, LPARAM lParam) {
+    for (size_t i = dialog->hooks.size(); i-- > 0; ) {
+        if (i >= dialog->hooks.size())
+            continue;
+        Hook hook = dialog->hooks[i];
+        LRESULT result = 0;
+        if (hook.hook(dialog->handle, message, wParam, lParam, hook.data, &result))
+            return result;
+    }
+    return HandleMessage(dialog, message, wParam, lParam);
+}
+
+HRESULT HeadlessBackend::Notify(Dialog* dialog, UINT notification, WPARAM wParam, LPARAM lParam) {
+    const TASKDIALOGCONFIG* config = dialog->config;
+    if (!config->pfCallback)
+        return S_OK;
+    return config->pfCallback(dialog->handle, notification, wParam, lParam, config->lpCallbackData);
+}
+
+// Shows a page, at first or after a navigation
+void HeadlessBackend::Construct(Dialog* dialog, const TASKDIALOGCONFIG* config) {
+    dialog->config = config;
+    dialog->timerStart = GetTickCount();
+    dialog->model.verificationChecked = (config->dwFlags & TDF_VERIFICATION_FLAG_CHECKED) ? TRUE : FALSE;
+    dialog->model.radioButton = 0;
+    if (config->cRadioButtons && !(config->dwFlags & TDF_NO_DEFAULT_RADIO_BUTTON))
+        dialog->model.radioButton = config->nDefaultRadioButton ? config->nDefaultRadioButton : config->pRadioButtons[0].nButtonID;
+    SetText(dialog->model.windowTitle, config->pszWindowTitle);
+    SetText(dialog->model.texts[TDE_CONTENT], config->pszContent);
+    SetText(dialog->model.texts[TDE_EXPANDED_INFORMATION], config->pszExpandedInformation);
+    SetText(dialog->model.texts[TDE_FOOTER], config->pszFooter);
+    SetText(dialog->model.texts[TDE_MAIN_INSTRUCTION], config->pszMainInstruction);
+
+    Notify(dialog, TDN_DIALOG_CONSTRUCTED);
+}
+
+// The dialog is closed unless the callback says otherwise, like comctl32 does
+void HeadlessBackend::ClickButton(Dialog* dialog, int buttonId) {
+    if (Notify(dialog, TDN_BUTTON_CLICKED, buttonId) == S_OK) {
+        dialog->button = buttonId;
+        dialog->closed = true;
+    }
+}
+
+// Strings loaded from resources are not supported
+void HeadlessBackend::SetText(std::wstring& text, PCWSTR value) {
+#if defined _WIN32
+    if (IS_INTRESOURCE(value))
+        value = NULL;
+#endif
+    if (value)
+        text = value;
+    else
+        text.clear();
+}
+
+LRESULT HeadlessBackend::HandleMessage(Dialog* dialog, UINT message, WPARAM wParam, LPARAM lParam) {
+    if (dialog->closed)
+        return 0;
+
+    switch (message) {
+
+        // Notifications
+        case WM_TIMER:
+            switch (wParam) {
+                case TimerTick:
+                    if (dialog->config->dwFlags & TDF_CALLBACK_TIMER) {
+                        if (Notify(dialog, TDN_TIMER, GetTickCount() - dialog->timerStart) == S_FALSE)
+                            dialog->timerStart = GetTickCount();
+                    }
+                    return 0;
+                case TimerClick:
+                    if (dialog->clickButton < dialog->config->cButtons)
+                        ClickButton(dialog, dialog->config->pButtons[dialog->clickButton].nButtonID);
+                    else
+                        ClickButton(dialog, IDOK);
+                    return 0;
+                case TimerClose:
+                    KillDialogTimer(dialog->handle, TimerClose);
+                    ClickButton(dialog, IDCANCEL);
+                    return 0;
+            }
+            return 0;
+
+        // Commands
+        case WM_SETTEXT:
+            SetText(dialog->model.windowTitle, reinterpret_cast<PCWSTR>(lParam));
+            return TRUE;
+        case TDM_CLICK_BUTTON:
+            ClickButton(dialog, static_cast<int>(wParam));
+            return 0;
+        case TDM_CLICK_RADIO_BUTTON:
+            dialog->model.radioButton = static_cast<int>(wParam);
+            Notify(dialog, TDN_RADIO_BUTTON_CLICKED, wParam);
+            return 0;
+        case TDM_CLICK_VERIFICATION:
+            dialog->model.verificationChecked = wParam ? TRUE : FALSE;
+            Notify(dialog, TDN_VERIFICATION_CLICKED, wParam);
+            return 0;
+        case TDM_SET_ELEMENT_TEXT:
+        case TDM_UPDATE_ELEMENT_TEXT:
+            if (wParam <= TDE_MAIN_INSTRUCTION)
+                SetText(dialog->model.texts[wParam], reinterpret_cast<PCWSTR>(lParam));
+            return TRUE;
+        case TDM_SET_PROGRESS_BAR_POS: {
+            int previous = dialog->model.progressPosition;
+            dialog->model.progressPosition = static_cast<int>(wParam);
+            return previous;
+        }
+        case TDM_SET_PROGRESS_BAR_STATE:
+            dialog->model.progressState = static_cast<int>(wParam);
+            return TRUE;
+        case TDM_SET_PROGRESS_BAR_RANGE: {
+            LPARAM previous = dialog->model.progressRange;
+            dialog->model.progressRange = lParam;
+            return previous;
+        }
+        case TDM_SET_MARQUEE_PROGRESS_BAR:
+        case TDM_SET_PROGRESS_BAR_MARQUEE:
+            dialog->model.progressMarquee = 0 != wParam;
+            return TRUE;
+        case TDM_NAVIGATE_PAGE:
+            Construct(dialog, reinterpret_cast<const TASKDIALOGCONFIG*>(lParam));
+            Notify(dialog, TDN_NAVIGATED);
+            return 0;
+    }
+
+    return 0;
+}
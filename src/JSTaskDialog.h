@@ -1,14 +1,16 @@
 #pragma once
 
 #include "TaskDialog.h"
+#include "EventPipeline.h"
+#include "LatencyHistogram.h"
+#include "TraceLog.h"
 
 #include <node.h>
 #include <v8.h>
-#include "cvv8/v8-convert.hpp"
 #include <uv.h>
 
 #include <vector>
-#include <queue>
+#include <string.h>
 
 using namespace v8;
 
@@ -26,39 +28,150 @@ class JSTaskDialog : public Kerr::TaskDialog {
 
         JSTaskDialog(Persistent<Function> callback);
         ~JSTaskDialog();
-        HRESULT DoModal(HWND parent = ::GetActiveWindow());
-        void NavigatePage(TaskDialog& dest);
+
+        // Event coalescing. The timer ticks skipped while older events wait in the overflow list
+        // also count as coalesced.
+        void SetCoalesceTimer(bool coalesce = true);
+        LONG GetCoalescedEvents() const;
+
+        // Event delivery mode
+        void SetBatchEvents(bool batch = true);
+
+        // Messages waiting to be delivered, timer ticks dropped because the queue was full,
+        // and other messages that had to wait in the overflow list. Called on the main thread only.
+        static LONG GetQueuedEvents();
+        static LONG GetDroppedEvents();
+        static LONG GetOverflowEvents();
+
+        // Highest number of messages found waiting by the main thread, and latencies of the events by name.
+        // Called on the main thread only.
+        static LONG GetQueueHighWater();
+        static Handle<Object> GetEventStats();
+
+        // Event subscription: events that nobody listens to are dropped on the dialog thread
+        bool SetEventSubscribed(const char* eventName, bool subscribed);
+        LONG GetSuppressedEvents() const;
+
+        // Templates
+        void UseTemplate(const JSTaskDialog& source);
+
+        // Values of the buttons, given back instead of their ids in events and results
+        void SetButtonValues(Handle<Array> values);
+        void SetRadioButtonValues(Handle<Array> values);
+        Handle<Value> GetButtonValue(int buttonId) const;
+        Handle<Value> GetRadioButtonValue(int buttonId) const;
+
+        // Calls a JS callback from the loop. An exception is reported like an uncaught one,
+        // and does not prevent the caller from going on with the next callbacks.
+        static void InvokeCallback(Handle<Function> callback, int argc, Handle<Value> argv[]);
 
     private:
 
-        class AsyncMessageDataBuilderBase {
-            public:
-                virtual Handle<Value> Build() { throw "Build() method not implemented"; }
+        // String owned by the dialog that raised an event.
+        // Strings are interned on the dialog thread (the same url clicked twice reuses the same entry)
+        // and are never modified nor freed while the dialog is alive, so the main thread can read them safely.
+        // They are kept in UTF-16, so that v8 strings are built from them without any transcoding.
+        struct InternedString {
+            InternedString* next;
+            PCWSTR value;
+            int length;
+        };
+
+        // Data attached to an event, stored by value in the message record.
+        // The main thread uses the tag to construct the corresponding v8 value.
+        // `TypeCoalesced` marks an event whose value must be read from the dialog's latest-wins slot when delivered.
+        // `TypeButton` and `TypeRadioButton` hold an id, delivered as the value of the corresponding button.
+        struct AsyncMessageData {
+            enum Type { TypeNone, TypeInt, TypeBool, TypeUInt32, TypeString, TypeCoalesced, TypeButton, TypeRadioButton } type;
+            union {
+                int intValue;
+                bool boolValue;
+                DWORD uintValue;
+                const InternedString* stringValue;
+            };
+
+            AsyncMessageData() : type(TypeNone) {}
+            explicit AsyncMessageData(int value) : type(TypeInt), intValue(value) {}
+            explicit AsyncMessageData(bool value) : type(TypeBool), boolValue(value) {}
+            explicit AsyncMessageData(DWORD value) : type(TypeUInt32), uintValue(value) {}
+            explicit AsyncMessageData(const InternedString* value) : type(TypeString), stringValue(value) {}
+            Handle<Value> Build(const JSTaskDialog* td) const;
+        };
+
+        // Events raised to JS.
+        // Their names, and the object template shared by all the event objects, are created once on the main thread.
+        enum EventId {
+            EventLoaded,
+            EventNavigated,
+            EventLink,
+            EventButton,
+            EventRadio,
+            EventVerification,
+            EventExpando,
+            EventTimer,
+            EventsCount
+        };
+        static const char* const _eventNames[EventsCount];
+        static Persistent<String> _eventSymbols[EventsCount];
+        static Persistent<String> _dataSymbol;
+        static Persistent<ObjectTemplate> _eventTemplate;
+
+        // Fixed-size record stored inline in the message queue.
+        // `queuedAt` is the `uv_hrtime` of the dialog thread raising the event.
+        struct AsyncMessage {
+            JSTaskDialog* td;
+            EventId event;
+            AsyncMessageData data;
+            uint64_t queuedAt;
         };
 
-        template<typename T>
-        class AsyncMessageDataBuilder : public AsyncMessageDataBuilderBase {
-            public:
-                AsyncMessageDataBuilder(T value);
-                Handle<Value> Build();
-            private:
-                T _value;
+        // Event taken from the queue, waiting for its listeners to return
+        struct AsyncMessageTiming {
+            EventId event;
+            uint64_t drainedAt;
         };
 
-        struct AsyncMessageBaton {
+        // Events collected for a dialog in batch mode during a single wakeup
+        struct AsyncMessageBatch {
             JSTaskDialog* td;
-            const char* eventName;
-            AsyncMessageDataBuilderBase* dataBuilder;
+            Local<Array> events;
+            uint32_t length;
+            std::vector<AsyncMessageTiming> timings;
         };
 
+        // Latencies of the events, by event: from the dialog thread to the main thread (queue),
+        // and from there to the return of the listeners (dispatch). Main thread only.
+        static LatencyHistogram _queueLatency[EventsCount];
+        static LatencyHistogram _dispatchLatency[EventsCount];
+        static LONG _queueHighWater;
+        static Handle<Object> BuildHistogram(const LatencyHistogram& histogram);
+
+        // Number of messages the queue can hold (must be a power of two). Further messages wait in the overflow list.
+        static const LONG AsyncMessagesCapacity = 1024;
+
         Persistent<Function> _callbackFunction;
+        Persistent<Array> _buttonValues;
+        Persistent<Array> _radioButtonValues;
+        InternedString* volatile _internedStrings;
+        bool _batchEvents;
+
+        // Latest-wins slot for the timer: while a tick is waiting in the queue,
+        // newer ticks only update the value instead of queueing another message
+        volatile bool _coalesceTimer;
+        LatestValueSlot _timerSlot;
+        volatile LONG _coalescedEvents;
+
+        // Bit `1 << EventId` is set for the events with at least one listener
+        volatile LONG _subscribedEvents;
+        volatile LONG _suppressedEvents;
         static uv_async_t _async;
-        static int _asyncReferences;
-        static std::queue<AsyncMessageBaton*>* _asyncMessages;
-        static uv_rwlock_t _asyncMessagesLock;
+        typedef OverflowEventQueue<AsyncMessage, AsyncMessagesCapacity> AsyncMessageQueue;
+        static AsyncMessageQueue _asyncMessages;
         static void AsyncMessageHandler(uv_async_t* handle, int status);
+        static void DeliverMessage(AsyncMessage& message, std::vector<AsyncMessageBatch>& batches);
 
-        void RaiseJSEvent(const char* eventName, AsyncMessageDataBuilderBase* dataBuilder);
+        const InternedString* InternString(PCWSTR str);
+        bool RaiseJSEvent(EventId event, const AsyncMessageData& data = AsyncMessageData());
         void OnDialogConstructed();
         void OnNavigated();
         void OnHyperlinkClicked(PCWSTR /*url*/);
@@ -73,25 +186,37 @@ class JSTaskDialog : public Kerr::TaskDialog {
 // JSTaskDialog - Implementation
 // ************************************************
 
-// Implementation of the methods for the AsyncMessageDataBuilder.
-// These classes are needed to provide a specific method to encapsulate values from the worker thread
-// and a generic method to allow the main thread to construct the correct corresponding v8 types.
-
-template<typename T>
-JSTaskDialog::AsyncMessageDataBuilder<T>::AsyncMessageDataBuilder(T value) :
-    _value(value)
-{
-}
-
-template<typename T>
-Handle<Value> JSTaskDialog::AsyncMessageDataBuilder<T>::Build() {
-    return cvv8::CastToJS<T>(_value);
+// Constructs the v8 value corresponding to the data of an event.
+// Called on the main thread only.
+Handle<Value> JSTaskDialog::AsyncMessageData::Build(const JSTaskDialog* td) const {
+    switch (type) {
+        case TypeInt:
+            return Integer::New(intValue);
+        case TypeBool:
+            return Boolean::New(boolValue);
+        case TypeUInt32:
+            return Integer::NewFromUnsigned(uintValue);
+        case TypeString:
+            return String::New(reinterpret_cast<const uint16_t*>(stringValue->value), stringValue->length);
+        case TypeButton:
+            return td->GetButtonValue(intValue);
+        case TypeRadioButton:
+            return td->GetRadioButtonValue(intValue);
+        default:
+            return Undefined();
+    }
 }
 
 //-----------------
 
 JSTaskDialog::JSTaskDialog(Persistent<Function> callback) :
-    _callbackFunction(callback)
+    _callbackFunction(callback),
+    _internedStrings(NULL),
+    _batchEvents(false),
+    _coalesceTimer(false),
+    _coalescedEvents(0),
+    _subscribedEvents(0),
+    _suppressedEvents(0)
 {
     SetMainIcon((ATL::_U_STRINGorID)(UINT)0);
     SetFooterIcon((ATL::_U_STRINGorID)(UINT)0);
@@ -99,123 +224,389 @@ JSTaskDialog::JSTaskDialog(Persistent<Function> callback) :
 
 JSTaskDialog::~JSTaskDialog() {
     _callbackFunction.Dispose();
+    _buttonValues.Dispose();
+    _radioButtonValues.Dispose();
+
+    // Frees the interned strings
+    InternedString* str = _internedStrings;
+    while (str) {
+        InternedString* next = str->next;
+        delete[] str->value;
+        delete str;
+        str = next;
+    }
+}
+
+// Event coalescing
+void JSTaskDialog::SetCoalesceTimer(bool coalesce) {
+    _coalesceTimer = coalesce;
+}
+
+LONG JSTaskDialog::GetCoalescedEvents() const {
+    return _coalescedEvents;
+}
+
+// Event delivery mode.
+// In batch mode, the callback is invoked once per wakeup with a single array `[ name1, event1, name2, event2, ... ]`
+// containing all the events of this dialog, instead of once per event with `(name, event)`.
+void JSTaskDialog::SetBatchEvents(bool batch) {
+    _batchEvents = batch;
+}
+
+// Subscribes to or unsubscribes from an event, by name.
+// Returns false if the dialog never raises such an event.
+// No event is subscribed initially.
+bool JSTaskDialog::SetEventSubscribed(const char* eventName, bool subscribed) {
+    for (int i = 0; i < EventsCount; i++) {
+        if (strcmp(eventName, _eventNames[i]) == 0) {
+            if (subscribed)
+                InterlockedOr(&_subscribedEvents, 1 << i);
+            else
+                InterlockedAnd(&_subscribedEvents, ~(1 << i));
+            return true;
+        }
+    }
+    return false;
+}
+
+LONG JSTaskDialog::GetSuppressedEvents() const {
+    return _suppressedEvents;
+}
+
+LONG JSTaskDialog::GetQueuedEvents() {
+    return _asyncMessages.GetSize();
+}
+
+LONG JSTaskDialog::GetDroppedEvents() {
+    return _asyncMessages.GetDroppedEvents();
+}
+
+LONG JSTaskDialog::GetOverflowEvents() {
+    return _asyncMessages.GetOverflowEvents();
+}
+
+LONG JSTaskDialog::GetQueueHighWater() {
+    return _queueHighWater;
+}
+
+// Returns `{ eventName: { Count, QueueLatency, DispatchLatency }, ... }` for the events raised at least once
+Handle<Object> JSTaskDialog::GetEventStats() {
+    HandleScope scope;
+    Handle<Object> stats = Object::New();
+    for (int i = 0; i < EventsCount; i++) {
+        if (!_queueLatency[i].GetCount())
+            continue;
+        Handle<Object> event = Object::New();
+        event->Set(String::NewSymbol("Count"), Number::New((double)_queueLatency[i].GetCount()));
+        event->Set(String::NewSymbol("QueueLatency"), BuildHistogram(_queueLatency[i]));
+        event->Set(String::NewSymbol("DispatchLatency"), BuildHistogram(_dispatchLatency[i]));
+        stats->Set(_eventSymbols[i], event);
+    }
+    return scope.Close(stats);
+}
+
+// Durations are in microseconds. `Buckets` lists the non-empty buckets, in order, as `[from, count]` pairs:
+// `count` durations of at least `from` microseconds, and less than the next bucket of LatencyHistogram.
+Handle<Object> JSTaskDialog::BuildHistogram(const LatencyHistogram& histogram) {
+    HandleScope scope;
+    Handle<Object> obj = Object::New();
+    obj->Set(String::NewSymbol("Count"), Number::New((double)histogram.GetCount()));
+    obj->Set(String::NewSymbol("Mean"), Number::New((double)histogram.GetMean()));
+    obj->Set(String::NewSymbol("P50"), Number::New((double)histogram.GetPercentile(50)));
+    obj->Set(String::NewSymbol("P99"), Number::New((double)histogram.GetPercentile(99)));
+    obj->Set(String::NewSymbol("Max"), Number::New((double)histogram.GetMax()));
+
+    Handle<Array> buckets = Array::New();
+    uint32_t length = 0;
+    for (int i = 0; i < LatencyHistogram::BucketsCount; i++) {
+        if (!histogram.GetBucket(i))
+            continue;
+        Handle<Array> bucket = Array::New(2);
+        bucket->Set(0, Number::New((double)LatencyHistogram::GetBucketLowerBound(i)));
+        bucket->Set(1, Integer::NewFromUnsigned(histogram.GetBucket(i)));
+        buckets->Set(length++, bucket);
+    }
+    obj->Set(String::NewSymbol("Buckets"), buckets);
+    return scope.Close(obj);
+}
+
+// Also copies the settings of the dialog that are not part of the configuration
+void JSTaskDialog::UseTemplate(const JSTaskDialog& source) {
+    Kerr::TaskDialog::UseTemplate(source);
+    _coalesceTimer = source._coalesceTimer;
+    SetButtonValues(source._buttonValues);
+    SetRadioButtonValues(source._radioButtonValues);
+}
+
+// Button values.
+// The arrays are replaced as a whole every time the buttons change, and never modified,
+// so they can be shared with the dialogs created from a template.
+// Called on the main thread only.
+void JSTaskDialog::SetButtonValues(Handle<Array> values) {
+    _buttonValues.Dispose();
+    _buttonValues = values.IsEmpty() ? Persistent<Array>() : Persistent<Array>::New(values);
+}
+
+void JSTaskDialog::SetRadioButtonValues(Handle<Array> values) {
+    _radioButtonValues.Dispose();
+    _radioButtonValues = values.IsEmpty() ? Persistent<Array>() : Persistent<Array>::New(values);
+}
+
+// Custom buttons have ids starting from 101 (plus 1000 for message-only buttons), the others are the common buttons
+Handle<Value> JSTaskDialog::GetButtonValue(int buttonId) const {
+    if (buttonId > 1000)
+        buttonId -= 1000;
+    if (buttonId >= 101 && !_buttonValues.IsEmpty() && (uint32_t)(buttonId - 101) < _buttonValues->Length())
+        return _buttonValues->Get(buttonId - 101);
+    switch (buttonId) {
+        case IDOK:
+            return String::NewSymbol("ok");
+        case IDCANCEL:
+            return String::NewSymbol("cancel");
+        default:
+            return Integer::New(buttonId);
+    }
+}
+
+Handle<Value> JSTaskDialog::GetRadioButtonValue(int buttonId) const {
+    if (buttonId >= 101 && !_radioButtonValues.IsEmpty() && (uint32_t)(buttonId - 101) < _radioButtonValues->Length())
+        return _radioButtonValues->Get(buttonId - 101);
+    return Integer::New(buttonId);
 }
 
-// Static initialization
+// Static initialization.
+// The async watcher is initialized once on the main thread and unreferenced,
+// so that it never keeps the loop alive by itself: the pending `Show` requests already do that.
+// Event objects are created from a template already holding the `data` field, so that they all share the same shape.
 void JSTaskDialog::Initialize() {
-    _asyncMessages = new std::queue<AsyncMessageBaton*>();
-    _asyncReferences = 0;
-    uv_rwlock_init(&_asyncMessagesLock);
+    uv_async_init(uv_default_loop(), &_async, JSTaskDialog::AsyncMessageHandler);
+    uv_unref((uv_handle_t*)&_async);
+
+    for (int i = 0; i < EventsCount; i++)
+        _eventSymbols[i] = Persistent<String>::New(String::NewSymbol(_eventNames[i]));
+    _dataSymbol = Persistent<String>::New(String::NewSymbol("data"));
+    _eventTemplate = Persistent<ObjectTemplate>::New(ObjectTemplate::New());
+    _eventTemplate->Set(_dataSymbol, Undefined());
 }
 
+// Events, in the order of `EventId`
+const char* const JSTaskDialog::_eventNames[EventsCount] = {
+    "loaded",
+    "navigated",
+    "click:link",
+    "click:button",
+    "click:radio",
+    "click:verification",
+    "click:expando",
+    "timer"
+};
+Persistent<String> JSTaskDialog::_eventSymbols[EventsCount];
+Persistent<String> JSTaskDialog::_dataSymbol;
+Persistent<ObjectTemplate> JSTaskDialog::_eventTemplate;
+
 // Async watcher
 uv_async_t JSTaskDialog::_async;
-int JSTaskDialog::_asyncReferences;
 
 // Message queue
-std::queue<JSTaskDialog::AsyncMessageBaton*>* JSTaskDialog::_asyncMessages;
-uv_rwlock_t JSTaskDialog::_asyncMessagesLock;
+JSTaskDialog::AsyncMessageQueue JSTaskDialog::_asyncMessages;
+
+// Statistics
+LatencyHistogram JSTaskDialog::_queueLatency[JSTaskDialog::EventsCount];
+LatencyHistogram JSTaskDialog::_dispatchLatency[JSTaskDialog::EventsCount];
+LONG JSTaskDialog::_queueHighWater = 0;
 
 // This function is called on the main thread, and is the only one allowed to use v8
 void JSTaskDialog::AsyncMessageHandler(uv_async_t* handle, int status) {
     HandleScope scope;
 
-    // Copyies the contents of the queue to a temporary array.
-    // We need to do this because we can't process the messages while keeping the read lock,
-    // because a callback could place a new message on the queue, causing a deadlock
-    std::vector<AsyncMessageBaton*> batons;
-    uv_rwlock_rdlock(&_asyncMessagesLock);
-        while (!_asyncMessages->empty()) {
-            batons.push_back(_asyncMessages->front());
-            _asyncMessages->pop();
-        }
-    uv_rwlock_rdunlock(&_asyncMessagesLock);
+    // Events of the dialogs in batch mode, delivered after the queue has been drained
+    std::vector<AsyncMessageBatch> batches;
+
+    // The queue is at its fullest right before being drained
+    LONG queued = _asyncMessages.GetSize();
+    if (queued > _queueHighWater)
+        _queueHighWater = queued;
+    TraceLog::Begin("AsyncMessageHandler", queued);
+
+    // Processes at most a full queue of messages per wakeup, then the overflow list once the queue is empty,
+    // so that dialogs raising events faster than we can dispatch them cannot starve the loop.
+    // Callbacks are free to cause new messages to be queued, since producers never wait on the consumer.
+    LONG processed = _asyncMessages.Drain([&batches](AsyncMessage& message) {
+        DeliverMessage(message, batches);
+    });
+
+    // Delivers the batches, with a single call per dialog
+    for (auto it = batches.begin(); it < batches.end(); ++it) {
+        Handle<Value> arr[] = { it->events };
+        TraceLog::Begin("Events", it->length / 2);
+        InvokeCallback(it->td->_callbackFunction, 1, arr);
+        TraceLog::End("Events");
+        uint64_t returnedAt = uv_hrtime();
+        for (auto timing = it->timings.begin(); timing < it->timings.end(); ++timing)
+            _dispatchLatency[timing->event].Record(returnedAt - timing->drainedAt);
+    }
 
-    // Processes all the messages on the queue
-    for (auto it = batons.begin(); it < batons.end(); ++it) {
-            
-        AsyncMessageBaton* baton = *it;
+    // There are still messages to process: schedule another round
+    if (processed == AsyncMessagesCapacity)
+        uv_async_send(&_async);
+    TraceLog::End("AsyncMessageHandler");
+}
+
+void JSTaskDialog::InvokeCallback(Handle<Function> callback, int argc, Handle<Value> argv[]) {
+    TryCatch tryCatch;
+    callback->Call(Context::GetCurrent()->Global(), argc, argv);
+    if (tryCatch.HasCaught())
+        node::FatalException(tryCatch);
+}
 
-        Handle<Object> eventObject = Object::New();
-        eventObject->Set(String::NewSymbol("data"), baton->dataBuilder ? baton->dataBuilder->Build() : Undefined());
+// Delivers a message right away, or adds it to the batch of its dialog
+void JSTaskDialog::DeliverMessage(AsyncMessage& message, std::vector<AsyncMessageBatch>& batches) {
+    uint64_t drainedAt = uv_hrtime();
+    _queueLatency[message.event].Record(drainedAt - message.queuedAt);
 
+    // Takes the latest value of a coalesced event
+    if (message.data.type == AsyncMessageData::TypeCoalesced)
+        message.data = AsyncMessageData((DWORD)message.td->_timerSlot.Take());
+
+    Handle<Object> eventObject = _eventTemplate->NewInstance();
+    eventObject->Set(_dataSymbol, message.data.Build(message.td));
+    Handle<String> eventName = _eventSymbols[message.event];
+
+    // Single event delivery
+    if (!message.td->_batchEvents) {
         Handle<Value> arr[] = {
-            String::New(baton->eventName),
+            eventName,
             eventObject
         };
-        baton->td->_callbackFunction->Call(Context::GetCurrent()->Global(), 2, arr);
-
-        delete baton->dataBuilder;
-        delete baton;
+        TraceLog::Begin(_eventNames[message.event]);
+        InvokeCallback(message.td->_callbackFunction, 2, arr);
+        TraceLog::End(_eventNames[message.event]);
+        _dispatchLatency[message.event].Record(uv_hrtime() - drainedAt);
+        return;
+    }
 
+    // Appends the event to the batch of its dialog
+    AsyncMessageBatch* batch = NULL;
+    for (auto it = batches.begin(); it < batches.end(); ++it) {
+        if (it->td == message.td) {
+            batch = &*it;
+            break;
+        }
+    }
+    if (!batch) {
+        AsyncMessageBatch newBatch;
+        newBatch.td = message.td;
+        newBatch.events = Array::New();
+        newBatch.length = 0;
+        batches.push_back(newBatch);
+        batch = &batches.back();
     }
+    batch->events->Set(batch->length++, eventName);
+    batch->events->Set(batch->length++, eventObject);
+    AsyncMessageTiming timing = { message.event, drainedAt };
+    batch->timings.push_back(timing);
 }
 
-void JSTaskDialog::RaiseJSEvent(const char* eventName, AsyncMessageDataBuilderBase* dataBuilder)
-{
-    AsyncMessageBaton* baton = new AsyncMessageBaton();
-    baton->td = this;
-    baton->eventName = eventName;
-    baton->dataBuilder = dataBuilder;
-
-    uv_rwlock_wrlock(&_asyncMessagesLock);
-        _asyncMessages->push(baton);
-    uv_rwlock_wrunlock(&_asyncMessagesLock);
-    uv_async_send(&_async);
+// Returns the interned copy of the given string, creating it if this is the first time it is seen.
+// Called on the dialog thread only: the heap is touched only the first time a string is interned.
+const JSTaskDialog::InternedString* JSTaskDialog::InternString(PCWSTR str) {
+    for (InternedString* it = _internedStrings; it; it = it->next)
+        if (wcscmp(it->value, str) == 0)
+            return it;
+
+    size_t length = wcslen(str);
+    wchar_t* value = new wchar_t[length + 1];
+    wmemcpy(value, str, length + 1);
+
+    InternedString* interned = new InternedString();
+    interned->value = value;
+    interned->length = static_cast<int>(length);
+    interned->next = _internedStrings;
+
+    // Publishes the new entry only once it is completely initialized
+    _internedStrings = interned;
+    return interned;
 }
 
-HRESULT JSTaskDialog::DoModal(HWND parent) {
-    if (_asyncReferences == 0)
-        uv_async_init(uv_default_loop(), &_async, JSTaskDialog::AsyncMessageHandler);
-
-    _asyncReferences++;
-    HRESULT res = Kerr::TaskDialog::DoModal(parent);
-    _asyncReferences--;
-
-    if (_asyncReferences == 0)
-        uv_close((uv_handle_t*)&_async, NULL);
-
-    return res;
-}
+bool JSTaskDialog::RaiseJSEvent(EventId event, const AsyncMessageData& data)
+{
+    // Nobody is listening: the event is not even queued
+    if (!(_subscribedEvents & (1 << event))) {
+        InterlockedIncrement(&_suppressedEvents);
+        return false;
+    }
 
-void JSTaskDialog::NavigatePage(TaskDialog& dest) {
-    ((JSTaskDialog&)dest)._async = this->_async;
-    Kerr::TaskDialog::NavigatePage(dest);
+    AsyncMessage message;
+    message.td = this;
+    message.event = event;
+    message.data = data;
+    message.queuedAt = uv_hrtime();
+    TraceLog::Instant(_eventNames[event]);
+
+    // A timer tick can be skipped, since a newer one follows shortly. Behind the overflow list, the newer one
+    // just takes its place, as with CoalesceTimer; only when the queue is full is the tick dropped.
+    // Other events are never lost: they wait in the overflow list.
+    switch (_asyncMessages.Push(message, event == EventTimer)) {
+        case AsyncMessageQueue::Queued:
+            uv_async_send(&_async);
+            return true;
+        case AsyncMessageQueue::Skipped:
+            InterlockedIncrement(&_coalescedEvents);
+            return false;
+        default:
+            return false;
+    }
 }
 
 void JSTaskDialog::OnDialogConstructed() {
-    RaiseJSEvent("loaded", NULL);
+    TraceLog::Instant("TDN_DIALOG_CONSTRUCTED");
+    RaiseJSEvent(EventLoaded);
 }
 
 void JSTaskDialog::OnNavigated() {
-    RaiseJSEvent("navigated", NULL);
+    RaiseJSEvent(EventNavigated);
 }
 
 void JSTaskDialog::OnHyperlinkClicked(PCWSTR url) {
-    char* str = "";
-    Kerr::CopyWStrToStr(str, url);
-    
-    RaiseJSEvent("click:link", new AsyncMessageDataBuilder<const char*>(str));
+    RaiseJSEvent(EventLink, AsyncMessageData(InternString(url)));
 }
 
 void JSTaskDialog::OnButtonClicked(int buttonId, bool& closeDialog) {
     closeDialog = buttonId < 1000; // Conventionally, message-only buttons have an ID > 1000
-    RaiseJSEvent("click:button", new AsyncMessageDataBuilder<int>(buttonId));
+    AsyncMessageData data(buttonId);
+    data.type = AsyncMessageData::TypeButton;
+    RaiseJSEvent(EventButton, data);
 }
 
 void JSTaskDialog::OnRadioButtonClicked(int buttonId) {
-    RaiseJSEvent("click:radio", new AsyncMessageDataBuilder<int>(buttonId));
+    AsyncMessageData data(buttonId);
+    data.type = AsyncMessageData::TypeRadioButton;
+    RaiseJSEvent(EventRadio, data);
 }
 
 void JSTaskDialog::OnVerificationClicked(bool checked) {
-    RaiseJSEvent("click:verification", new AsyncMessageDataBuilder<bool>(checked));
+    RaiseJSEvent(EventVerification, AsyncMessageData(checked));
 }
 
 void JSTaskDialog::OnExpandoButtonClicked(bool expanded) {
-    RaiseJSEvent("click:expando", new AsyncMessageDataBuilder<bool>(expanded));
+    RaiseJSEvent(EventExpando, AsyncMessageData(expanded));
 }
 
 void JSTaskDialog::OnTimer(DWORD milliseconds, bool& reset) {
     reset = false;
-    RaiseJSEvent("timer", new AsyncMessageDataBuilder<unsigned long>(milliseconds));
+
+    if (!_coalesceTimer) {
+        RaiseJSEvent(EventTimer, AsyncMessageData(milliseconds));
+        return;
+    }
+
+    // If a tick is already waiting to be delivered, it will carry this value instead
+    if (!_timerSlot.Set((LONG)milliseconds)) {
+        InterlockedIncrement(&_coalescedEvents);
+        return;
+    }
+    AsyncMessageData data;
+    data.type = AsyncMessageData::TypeCoalesced;
+    if (!RaiseJSEvent(EventTimer, data))
+        _timerSlot.Clear();
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+// ************************************************
+// LatencyHistogram - Class definition
+// ************************************************
+
+// Histogram of durations in microseconds, laid out like an HDR histogram: below 2 * SubBuckets microseconds
+// every duration has its own bucket, and above, each power of two is split in SubBuckets buckets of equal width.
+// A bucket is thus never wider than 1/SubBuckets of its lower bound, so the percentiles are within about 6%
+// (instead of a factor of two with one bucket per power of two), and recording stays a few shifts.
+// Durations of 2^32 microseconds (about 71 minutes) or more are counted in the last bucket.
+// Not thread safe.
+class LatencyHistogram {
+
+    public:
+
+        static const int SubBuckets = 16;
+        // Two SubBuckets for the durations below 2 * SubBuckets, then one for each power of two up to 2^32
+        static const int BucketsCount = (32 - 5) * SubBuckets + 2 * SubBuckets;
+
+        LatencyHistogram();
+
+        void Record(uint64_t nanoseconds);
+
+        uint64_t GetCount() const;
+        uint64_t GetMean() const;       // Microseconds
+        uint64_t GetMax() const;        // Microseconds
+        uint32_t GetBucket(int i) const;
+
+        // Smallest duration counted in bucket `i`, in microseconds
+        static uint64_t GetBucketLowerBound(int i);
+
+        // Largest duration of the bucket holding the given percentile (but not more than the maximum,
+        // and the maximum in the last bucket), in microseconds
+        uint64_t GetPercentile(double percentile) const;
+
+    private:
+
+        uint32_t _buckets[BucketsCount];
+        uint64_t _count;
+        uint64_t _total;
+        uint64_t _max;
+
+        // Number of bits dropped from the durations of bucket `i`, which is `log2` of its width
+        static int GetBucketShift(int i);
+};
+
+// ************************************************
+// LatencyHistogram - Implementation
+// ************************************************
+
+LatencyHistogram::LatencyHistogram() :
+    _count(0),
+    _total(0),
+    _max(0)
+{
+    for (int i = 0; i < BucketsCount; i++)
+        _buckets[i] = 0;
+}
+
+// Durations from 2^(shift + 4) to 2^(shift + 5) keep their 5 highest bits, 1xxxx, and go to the buckets
+// from `SubBuckets * (shift + 1)` on
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+    uint64_t microseconds = nanoseconds / 1000;
+    uint64_t clamped = microseconds < 0xFFFFFFFF ? microseconds : 0xFFFFFFFF;
+    int shift = 0;
+    while ((clamped >> shift) >= 2 * SubBuckets)
+        shift++;
+    _buckets[shift * SubBuckets + (int)(clamped >> shift)]++;
+    _count++;
+    _total += microseconds;
+    if (microseconds > _max)
+        _max = microseconds;
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return _count;
+}
+
+uint64_t LatencyHistogram::GetMean() const {
+    return _count ? _total / _count : 0;
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    return _max;
+}
+
+uint32_t LatencyHistogram::GetBucket(int i) const {
+    return _buckets[i];
+}
+
+int LatencyHistogram::GetBucketShift(int i) {
+    return i < 2 * SubBuckets ? 0 : i / SubBuckets - 1;
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(int i) {
+    int shift = GetBucketShift(i);
+    return (uint64_t)(i - shift * SubBuckets) << shift;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    uint64_t threshold = (uint64_t)(_count * percentile / 100);
+    uint64_t seen = 0;
+    for (int i = 0; i < BucketsCount; i++) {
+        seen += _buckets[i];
+        if (seen > threshold && i < BucketsCount - 1) {
+            uint64_t bound = GetBucketLowerBound(i) + ((uint64_t)1 << GetBucketShift(i)) - 1;
+            return bound < _max ? bound : _max;
+        }
+    }
+    return _max;
+}
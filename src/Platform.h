@@ -0,0 +1,392 @@
+#pragma once
+
+// ************************************************
+// Platform - Win32 subset for the portable code
+// ************************************************
+
+// The parts of the addon that do not need a real dialog (queues, transcoding, allocators, the threads of the
+// dialogs, the headless backend) are written against the Win32 API like the rest of it. On other platforms,
+// where they are built for the tests and the benchmarks, this header provides the small subset of the API
+// that they use.
+
+#if defined _WIN32
+
+#include <windows.h>
+#include <commctrl.h>
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <wchar.h>
+
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef uint16_t WORD;
+typedef int BOOL;
+typedef wchar_t* PWSTR;
+typedef const wchar_t* PCWSTR;
+typedef void* PVOID;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t UINT_PTR;
+typedef uintptr_t DWORD_PTR;
+typedef uintptr_t WPARAM;
+typedef intptr_t LPARAM;
+typedef intptr_t LRESULT;
+typedef LONG HRESULT;
+
+#ifndef TRUE
+    #define TRUE 1
+    #define FALSE 0
+#endif
+
+#define CALLBACK
+#define INFINITE 0xFFFFFFFF
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define MAKELPARAM(low, high) ((LPARAM)(DWORD)(((WORD)(low)) | (((DWORD)(WORD)(high)) << 16)))
+
+inline LONG InterlockedCompareExchange(volatile LONG* destination, LONG exchange, LONG comparand) {
+    return __sync_val_compare_and_swap(destination, comparand, exchange);
+}
+
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) {
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedIncrement(volatile LONG* addend) {
+    return __sync_add_and_fetch(addend, 1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* addend) {
+    return __sync_sub_and_fetch(addend, 1);
+}
+
+inline LONG InterlockedOr(volatile LONG* destination, LONG value) {
+    return __sync_fetch_and_or(destination, value);
+}
+
+inline LONG InterlockedAnd(volatile LONG* destination, LONG value) {
+    return __sync_fetch_and_and(destination, value);
+}
+
+// ************************************************
+// Threads and time
+// ************************************************
+
+inline DWORD GetTickCount() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (DWORD)((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+inline DWORD GetCurrentThreadId() {
+    static volatile LONG lastId = 0;
+    static __thread DWORD id = 0;
+    if (!id)
+        id = (DWORD)InterlockedIncrement(&lastId);
+    return id;
+}
+
+// Recursive, like a Win32 critical section
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+inline void InitializeCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(section, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+inline void DeleteCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_destroy(section);
+}
+
+inline void EnterCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_lock(section);
+}
+
+inline void LeaveCriticalSection(CRITICAL_SECTION* section) {
+    pthread_mutex_unlock(section);
+}
+
+// Condition variables, used with a critical section entered once
+typedef pthread_cond_t CONDITION_VARIABLE;
+
+inline void InitializeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_init(condition, NULL);
+}
+
+inline BOOL SleepConditionVariableCS(CONDITION_VARIABLE* condition, CRITICAL_SECTION* section, DWORD /*milliseconds*/) {
+    return pthread_cond_wait(condition, section) == 0;
+}
+
+inline void WakeConditionVariable(CONDITION_VARIABLE* condition) {
+    pthread_cond_signal(condition);
+}
+
+// Events are the only kind of handle: the handle of a thread is a manual-reset event set when the thread exits.
+// A handle is deleted once it is closed and, for a thread, once the thread has exited.
+struct PlatformEvent {
+    pthread_mutex_t mutex;
+    pthread_cond_t signal;
+    bool manualReset;
+    bool signaled;
+    volatile LONG references;
+};
+
+typedef PlatformEvent* HANDLE;
+
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+
+inline HANDLE CreateEventW(void* /*attributes*/, BOOL manualReset, BOOL initialState, PCWSTR /*name*/) {
+    PlatformEvent* event = new PlatformEvent;
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->signal, NULL);
+    event->manualReset = manualReset != FALSE;
+    event->signaled = initialState != FALSE;
+    event->references = 1;
+    return event;
+}
+
+inline BOOL CloseHandle(HANDLE event) {
+    if (InterlockedDecrement(&event->references) != 0)
+        return TRUE;
+    pthread_cond_destroy(&event->signal);
+    pthread_mutex_destroy(&event->mutex);
+    delete event;
+    return TRUE;
+}
+
+inline BOOL SetEvent(HANDLE event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = true;
+    pthread_cond_broadcast(&event->signal);
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+inline DWORD WaitForSingleObject(HANDLE event, DWORD milliseconds) {
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&event->mutex);
+    while (!event->signaled) {
+        int error = milliseconds == INFINITE
+            ? pthread_cond_wait(&event->signal, &event->mutex)
+            : pthread_cond_timedwait(&event->signal, &event->mutex, &deadline);
+        if (error == ETIMEDOUT)
+            break;
+    }
+    bool signaled = event->signaled;
+    if (signaled && !event->manualReset)
+        event->signaled = false;
+    pthread_mutex_unlock(&event->mutex);
+    return signaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
+
+typedef DWORD (CALLBACK* LPTHREAD_START_ROUTINE)(PVOID parameter);
+
+struct PlatformThread {
+    LPTHREAD_START_ROUTINE start;
+    PVOID parameter;
+    HANDLE exited;
+};
+
+inline void* PlatformThreadMain(void* argument) {
+    PlatformThread* thread = static_cast<PlatformThread*>(argument);
+    thread->start(thread->parameter);
+    SetEvent(thread->exited);
+    CloseHandle(thread->exited);
+    delete thread;
+    return NULL;
+}
+
+// The thread is detached: its handle can be closed at any time
+inline HANDLE CreateThread(void* /*attributes*/, size_t /*stackSize*/, LPTHREAD_START_ROUTINE start, PVOID parameter,
+                           DWORD /*flags*/, DWORD* /*threadId*/) {
+    HANDLE exited = CreateEventW(NULL, TRUE, FALSE, NULL);
+    exited->references = 2;
+    PlatformThread* thread = new PlatformThread;
+    thread->start = start;
+    thread->parameter = parameter;
+    thread->exited = exited;
+
+    pthread_t id;
+    if (pthread_create(&id, NULL, PlatformThreadMain, thread) != 0) {
+        delete thread;
+        CloseHandle(exited);
+        CloseHandle(exited);
+        return NULL;
+    }
+    pthread_detach(id);
+    return exited;
+}
+
+// ************************************************
+// Task dialogs
+// ************************************************
+
+// The declarations of commctrl.h used by the dialog backends, with the same values.
+// Dialog handles are opaque: the headless backend numbers its dialogs.
+
+struct PlatformWindow;
+typedef PlatformWindow* HWND;
+typedef void* HINSTANCE;
+typedef void* HICON;
+
+#define IDOK 1
+#define IDCANCEL 2
+
+#define WM_USER 0x0400
+#define WM_SETTEXT 0x000C
+#define WM_TIMER 0x0113
+
+#define PBST_NORMAL 0x0001
+#define PBST_ERROR 0x0002
+#define PBST_PAUSED 0x0003
+
+typedef HRESULT (CALLBACK* PFTASKDIALOGCALLBACK)(HWND handle, UINT notification, WPARAM wParam, LPARAM lParam, LONG_PTR data);
+
+enum _TASKDIALOG_FLAGS {
+    TDF_ENABLE_HYPERLINKS = 0x0001,
+    TDF_USE_HICON_MAIN = 0x0002,
+    TDF_USE_HICON_FOOTER = 0x0004,
+    TDF_ALLOW_DIALOG_CANCELLATION = 0x0008,
+    TDF_USE_COMMAND_LINKS = 0x0010,
+    TDF_USE_COMMAND_LINKS_NO_ICON = 0x0020,
+    TDF_EXPAND_FOOTER_AREA = 0x0040,
+    TDF_EXPANDED_BY_DEFAULT = 0x0080,
+    TDF_VERIFICATION_FLAG_CHECKED = 0x0100,
+    TDF_SHOW_PROGRESS_BAR = 0x0200,
+    TDF_SHOW_MARQUEE_PROGRESS_BAR = 0x0400,
+    TDF_CALLBACK_TIMER = 0x0800,
+    TDF_POSITION_RELATIVE_TO_WINDOW = 0x1000,
+    TDF_RTL_LAYOUT = 0x2000,
+    TDF_NO_DEFAULT_RADIO_BUTTON = 0x4000,
+    TDF_CAN_BE_MINIMIZED = 0x8000
+};
+typedef int TASKDIALOG_FLAGS;
+typedef int TASKDIALOG_COMMON_BUTTON_FLAGS;
+
+typedef enum _TASKDIALOG_MESSAGES {
+    TDM_NAVIGATE_PAGE = WM_USER + 101,
+    TDM_CLICK_BUTTON = WM_USER + 102,
+    TDM_SET_MARQUEE_PROGRESS_BAR = WM_USER + 103,
+    TDM_SET_PROGRESS_BAR_STATE = WM_USER + 104,
+    TDM_SET_PROGRESS_BAR_RANGE = WM_USER + 105,
+    TDM_SET_PROGRESS_BAR_POS = WM_USER + 106,
+    TDM_SET_PROGRESS_BAR_MARQUEE = WM_USER + 107,
+    TDM_SET_ELEMENT_TEXT = WM_USER + 108,
+    TDM_CLICK_RADIO_BUTTON = WM_USER + 110,
+    TDM_ENABLE_BUTTON = WM_USER + 111,
+    TDM_ENABLE_RADIO_BUTTON = WM_USER + 112,
+    TDM_CLICK_VERIFICATION = WM_USER + 113,
+    TDM_UPDATE_ELEMENT_TEXT = WM_USER + 114,
+    TDM_SET_BUTTON_ELEVATION_REQUIRED_STATE = WM_USER + 115,
+    TDM_UPDATE_ICON = WM_USER + 116
+} TASKDIALOG_MESSAGES;
+
+typedef enum _TASKDIALOG_NOTIFICATIONS {
+    TDN_CREATED = 0,
+    TDN_NAVIGATED = 1,
+    TDN_BUTTON_CLICKED = 2,
+    TDN_HYPERLINK_CLICKED = 3,
+    TDN_TIMER = 4,
+    TDN_DESTROYED = 5,
+    TDN_RADIO_BUTTON_CLICKED = 6,
+    TDN_DIALOG_CONSTRUCTED = 7,
+    TDN_VERIFICATION_CLICKED = 8,
+    TDN_HELP = 9,
+    TDN_EXPANDO_BUTTON_CLICKED = 10
+} TASKDIALOG_NOTIFICATIONS;
+
+typedef enum _TASKDIALOG_ELEMENTS {
+    TDE_CONTENT,
+    TDE_EXPANDED_INFORMATION,
+    TDE_FOOTER,
+    TDE_MAIN_INSTRUCTION
+} TASKDIALOG_ELEMENTS;
+
+struct TASKDIALOG_BUTTON {
+    int nButtonID;
+    PCWSTR pszButtonText;
+};
+
+struct TASKDIALOGCONFIG {
+    UINT cbSize;
+    HWND hwndParent;
+    HINSTANCE hInstance;
+    TASKDIALOG_FLAGS dwFlags;
+    TASKDIALOG_COMMON_BUTTON_FLAGS dwCommonButtons;
+    PCWSTR pszWindowTitle;
+    union {
+        HICON hMainIcon;
+        PCWSTR pszMainIcon;
+    };
+    PCWSTR pszMainInstruction;
+    PCWSTR pszContent;
+    UINT cButtons;
+    const TASKDIALOG_BUTTON* pButtons;
+    int nDefaultButton;
+    UINT cRadioButtons;
+    const TASKDIALOG_BUTTON* pRadioButtons;
+    int nDefaultRadioButton;
+    PCWSTR pszVerificationText;
+    PCWSTR pszExpandedInformation;
+    PCWSTR pszExpandedControlText;
+    PCWSTR pszCollapsedControlText;
+    union {
+        HICON hFooterIcon;
+        PCWSTR pszFooterIcon;
+    };
+    PCWSTR pszFooter;
+    PFTASKDIALOGCALLBACK pfCallback;
+    LONG_PTR lpCallbackData;
+    UINT cxWidth;
+};
+
+#endif
+
+// Volatile accesses ordering the accesses around them.
+// MSVC gives acquire semantics to every volatile read and release semantics to every volatile write,
+// other compilers need to be told.
+#if defined _MSC_VER
+
+template<typename T>
+inline T LoadAcquire(const volatile T& source) {
+    return source;
+}
+
+template<typename T>
+inline void StoreRelease(volatile T& destination, T value) {
+    destination = value;
+}
+
+#else
+
+template<typename T>
+inline T LoadAcquire(const volatile T& source) {
+    return __atomic_load_n(&source, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+inline void StoreRelease(volatile T& destination, T value) {
+    __atomic_store_n(&destination, value, __ATOMIC_RELEASE);
+}
+
+#endif
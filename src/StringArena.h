@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// ************************************************
+// StringArena - Class definition
+// ************************************************
+
+// Bump allocator for the strings owned by a dialog.
+// Strings are carved out of large chunks and are never freed one by one:
+// the whole arena is released at once, either when it is destroyed or when it is replaced by a new generation
+// holding only the strings that are still in use.
+// Not thread safe.
+class StringArena {
+
+    public:
+
+        StringArena();
+        ~StringArena();
+
+        // Returns a buffer with room for `length` characters plus the terminator
+        PWSTR Allocate(size_t length);
+
+        // Copies a string into this arena
+        PCWSTR Copy(PCWSTR str);
+
+        // Whether `str` has been allocated by this arena
+        bool Owns(PCWSTR str) const;
+
+        // Number of characters allocated so far
+        size_t GetUsed() const;
+
+        // Moves the strings pointed to by `fields`, the ones still in use, into a new generation of the arena
+        // and frees the previous one. This is done only when most of the arena is made of other strings,
+        // which keeps it within about twice the strings in use. Returns whether the arena has been compacted.
+        // `MayNeedCompacting` tells in constant time whether the arena has grown enough since the last call
+        // for it to be worth collecting the fields at all.
+        bool MayNeedCompacting() const;
+        bool Compact(PCWSTR* const* fields, size_t count);
+
+        void Swap(StringArena& other);
+
+    private:
+
+        struct Chunk {
+            Chunk* next;
+            size_t capacity;
+            size_t used;
+            wchar_t data[1];
+        };
+
+        // Characters per chunk. Larger strings get a chunk of their own.
+        static const size_t ChunkCapacity = 4096;
+
+        Chunk* _chunks;
+        size_t _used;
+        size_t _compactAt;      // Size below which compacting is not even considered
+
+        // Non copyable
+        StringArena(const StringArena&);
+        StringArena& operator=(const StringArena&);
+};
+
+// ************************************************
+// StringArena - Implementation
+// ************************************************
+
+StringArena::StringArena() :
+    _chunks(NULL),
+    _used(0),
+    _compactAt(0)
+{
+}
+
+StringArena::~StringArena() {
+    Chunk* chunk = _chunks;
+    while (chunk) {
+        Chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+PWSTR StringArena::Allocate(size_t length) {
+    size_t size = length + 1;
+
+    // Allocates a new chunk if the current one is full.
+    // A chunk for a large string is put behind the current one, so that the latter can still be filled.
+    if (!_chunks || _chunks->capacity - _chunks->used < size) {
+        size_t capacity = size > ChunkCapacity ? size : ChunkCapacity;
+        Chunk* chunk = (Chunk*)malloc(offsetof(Chunk, data) + capacity * sizeof(wchar_t));
+        if (!chunk)
+            throw std::bad_alloc();
+        chunk->capacity = capacity;
+        chunk->used = 0;
+        if (_chunks && capacity > ChunkCapacity) {
+            chunk->next = _chunks->next;
+            _chunks->next = chunk;
+        } else {
+            chunk->next = _chunks;
+            _chunks = chunk;
+        }
+
+        chunk->used = size;
+        _used += size;
+        return chunk->data;
+    }
+
+    PWSTR str = _chunks->data + _chunks->used;
+    _chunks->used += size;
+    _used += size;
+    return str;
+}
+
+PCWSTR StringArena::Copy(PCWSTR str) {
+    size_t length = wcslen(str);
+    PWSTR copy = Allocate(length);
+    wmemcpy(copy, str, length + 1);
+    return copy;
+}
+
+bool StringArena::Owns(PCWSTR str) const {
+    for (Chunk* chunk = _chunks; chunk; chunk = chunk->next)
+        if (str >= chunk->data && str < chunk->data + chunk->used)
+            return true;
+    return false;
+}
+
+size_t StringArena::GetUsed() const {
+    return _used;
+}
+
+bool StringArena::MayNeedCompacting() const {
+    return _used > _compactAt;
+}
+
+bool StringArena::Compact(PCWSTR* const* fields, size_t count) {
+    if (!MayNeedCompacting())
+        return false;
+
+    // Only worth it when the strings in use are less than half of the arena, and it spans more than a chunk
+    size_t live = 0;
+    for (size_t i = 0; i < count; i++)
+        live += wcslen(*fields[i]) + 1;
+    _compactAt = 2 * live + ChunkCapacity;
+    if (_used <= _compactAt)
+        return false;
+
+    StringArena strings;
+    for (size_t i = 0; i < count; i++)
+        *fields[i] = strings.Copy(*fields[i]);
+    Swap(strings);
+    return true;
+}
+
+// The compaction threshold stays with each arena
+void StringArena::Swap(StringArena& other) {
+    Chunk* chunks = _chunks;
+    size_t used = _used;
+    _chunks = other._chunks;
+    _used = other._used;
+    other._chunks = chunks;
+    other._used = used;
+}
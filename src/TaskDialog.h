@@ -26,10 +26,20 @@
 // From WTL
 #include "wtl/atlapp.h"
 
+// Queue for the commands sent to the dialog, and write-combining of its updates
+#include "UpdatePipeline.h"
+
 // Includes some headers to manage Utf8-Utf16 conversion
-#include <locale>
-#include <codecvt>
-#include <string>
+#include "Utf8.h"
+
+// Allocator for the strings of the dialog
+#include "StringArena.h"
+
+// Implementations of the dialogs
+#include "DialogBackend.h"
+
+// Optional timeline of the commands
+#include "TraceLog.h"
 
 // Links to Common Controls 6 library
 #if defined _M_IX86
@@ -62,43 +72,12 @@
 
 namespace Kerr
 {
-    void CopyStrToWStr(PCWSTR& dest, const char* source)
-    {
-        #pragma warning(push)
-        #pragma warning(disable:4996)
-
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        std::wstring wsource = converter.from_bytes(source);
-        wchar_t* wdest = new wchar_t[wsource.length() + 1];
-        std::size_t charsCopied = wsource.copy(wdest, wsource.length());
-        wdest[charsCopied] = L'\0';
-        if (dest)
-            delete[] dest;
-        dest = wdest;
-
-        #pragma warning(pop)
-    }
-
-    void CopyWStrToStr(char*& dest, PCWSTR wsource)
-    {
-        #pragma warning(push)
-        #pragma warning(disable:4996)
-
-        std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
-        std::string source = converter.to_bytes(wsource);
-        dest = new char[source.length() + 1];
-        std::size_t charsCopied = source.copy(dest, source.length());
-        dest[charsCopied] = '\0';
-
-        #pragma warning(pop)
-    }
-
     class TaskDialog : public CWindow
     {
     public:
 
         explicit TaskDialog();
-        virtual ~TaskDialog() {}
+        virtual ~TaskDialog();
 
         // Set text captions
         void SetWindowTitle(ATL::_U_STRINGorID text);
@@ -110,6 +89,22 @@ namespace Kerr
         void SetCollapsedControlText(ATL::_U_STRINGorID text);
         void SetFooter(ATL::_U_STRINGorID text);
 
+        // Set text captions from UTF-16 strings allocated with AllocString.
+        // The dialog takes ownership of the string.
+        PWSTR AllocString(size_t length);
+        void CompactStrings();
+        void SetWindowTitle(PCWSTR text);
+        void SetMainInstruction(PCWSTR text);
+        void SetContent(PCWSTR text);
+        void SetVerificationText(PCWSTR text);
+        void SetExpandedInformation(PCWSTR text);
+        void SetExpandedControlText(PCWSTR text);
+        void SetCollapsedControlText(PCWSTR text);
+        void SetFooter(PCWSTR text);
+
+        // Shares the configuration and the strings of another dialog
+        void UseTemplate(const TaskDialog& source);
+
         // Set icons
         void SetMainIcon(HICON handle);
         void SetMainIcon(ATL::_U_STRINGorID resource);
@@ -125,6 +120,21 @@ namespace Kerr
         void AddRadioButton(ATL::_U_STRINGorID text,
                             int id);
 
+        void AddButton(PCWSTR text,
+                       int id);
+
+        void AddRadioButton(PCWSTR text,
+                            int id);
+
+        // Replace the button at index, or add it if index is the number of buttons
+        void SetButton(size_t index,
+                       PCWSTR text,
+                       int id);
+
+        void SetRadioButton(size_t index,
+                            PCWSTR text,
+                            int id);
+
         // Flags
         void SetCommonButtons(TASKDIALOG_COMMON_BUTTON_FLAGS commonButtons);
         void SetUseLinks(bool useLinks = true);
@@ -135,6 +145,10 @@ namespace Kerr
         void SetMinimizable(bool minimizable = true);
 
         virtual HRESULT DoModal(HWND parent = ::GetActiveWindow());
+
+        // Backend showing the dialogs from now on. NULL restores the comctl32 dialogs.
+        // A visible dialog keeps the backend that shows it.
+        static void SetBackend(DialogBackend* backend);
         int GetSelectedButtonId() const;
         int GetSelectedRadioButtonId() const;
         bool VerificiationChecked() const;
@@ -154,6 +168,10 @@ namespace Kerr
         virtual void NavigatePage(TaskDialog& newDialog);
         virtual void ResetTimer();
 
+        // Write-combining of live updates
+        void SetUpdateInterval(DWORD milliseconds);
+        LONG GetElidedUpdates() const;
+
     protected:
 
         // Events
@@ -180,15 +198,116 @@ namespace Kerr
         int m_selectedRadioButtonId;
         BOOL m_verificationChecked;
         BOOL m_resetTimer;
+
+    private:
+
+        // Strings of the configuration and of the buttons.
+        // Replaced strings are not freed one by one: they are reclaimed all at once by CompactStrings.
+        // While the dialog is visible, AllocString returns heap strings instead, since they are only kept
+        // until the dialog thread applies them. The setters fix up the rare string allocated just before
+        // the dialog was shown or closed, so that each string ends up where it belongs.
+        PCWSTR ConvertString(const char* text);
+        PCWSTR KeepString(PCWSTR text);
+        PCWSTR LiveString(PCWSTR text);
+        void GetStringFields(CAtlArray<PCWSTR*>& fields);
+
+        StringArena m_strings;
+
+        // Commands for the visible dialog.
+        // Instead of blocking the calling thread with a SendMessage until the dialog thread handles it,
+        // commands are queued and a single message is posted to make the dialog thread process all of them in order.
+        // `text`, if any, is a heap string owned by the command and passed as lParam.
+        // Nothing else passed to a command may point to memory of the caller, since it is used later.
+        struct Command
+        {
+            UINT message;
+            WPARAM wParam;
+            LPARAM lParam;
+            PCWSTR text;
+        };
+
+        void PostCommand(UINT message, 
+                         WPARAM wParam = 0, 
+                         LPARAM lParam = 0, 
+                         PCWSTR text = NULL);
+        void ProcessCommands(HWND handle, 
+                             bool execute);
+
+        static bool CommandsHook(HWND handle, 
+                                 UINT message, 
+                                 WPARAM wParam, 
+                                 LPARAM lParam, 
+                                 DWORD_PTR data, 
+                                 LRESULT* result);
+
+        static const UINT s_processCommandsMessage;
+
+        CommandQueue<Command, 256> m_commands;
+
+        // Write-combined updates for the visible dialog.
+        // Element texts and progress bar values can be set thousands of times per second:
+        // only the latest value of each one is kept, and the dialog thread applies them
+        // at most once every `m_updateInterval` milliseconds.
+        // Updates are state rather than actions, so they are not ordered with the commands: a flush first
+        // processes the commands queued so far, then applies the latest values. An update is thus never
+        // applied before a command issued earlier, but may be applied after a command issued later.
+        enum PendingUpdate
+        {
+            PendingMarquee = 1,
+            PendingState = 2,
+            PendingPosition = 4
+        };
+
+        void CombineUpdate(PendingUpdate update);
+        void CombineText(TASKDIALOG_ELEMENTS element, 
+                         PCWSTR text);
+        void RequestUpdatesFlush();
+        void FlushUpdates(HWND handle);
+        void DiscardUpdates();
+
+        static const UINT s_flushUpdatesMessage;
+        static const UINT_PTR s_flushUpdatesTimer = 0x4B657272;
+
+        UpdateCombiner m_updates;
+        volatile LONG m_progressValues; // Progress bar values ever set, applied again when the dialog is shown
+        volatile LONG m_pendingMarquee;
+        volatile LONG m_pendingMarqueeSpeed;
+        volatile LONG m_pendingState;
+        volatile LONG m_pendingPosition;
+        PVOID volatile m_pendingTexts[TDE_MAIN_INSTRUCTION + 1]; // Owned heap PCWSTR, indexed by element
+        volatile DWORD m_updateInterval;
+        DWORD m_lastFlush;
+
+        // Every message, timer and hook of the visible dialog goes through the backend that shows it
+        DialogBackend* m_backend;
+
+        static Comctl32Backend s_comctl32Backend;
+        static DialogBackend* volatile s_backend;
     };
 }
 
+const UINT Kerr::TaskDialog::s_processCommandsMessage = ::RegisterWindowMessageW(L"Kerr.TaskDialog.ProcessCommands");
+const UINT Kerr::TaskDialog::s_flushUpdatesMessage = ::RegisterWindowMessageW(L"Kerr.TaskDialog.FlushUpdates");
+Comctl32Backend Kerr::TaskDialog::s_comctl32Backend;
+DialogBackend* volatile Kerr::TaskDialog::s_backend = &Kerr::TaskDialog::s_comctl32Backend;
+
 Kerr::TaskDialog::TaskDialog() :
     m_selectedButtonId(0),
     m_selectedRadioButtonId(0),
     m_verificationChecked(FALSE),
-    m_resetTimer(FALSE)
+    m_resetTimer(FALSE),
+    m_progressValues(0),
+    m_pendingMarquee(FALSE),
+    m_pendingMarqueeSpeed(0),
+    m_pendingState(0),
+    m_pendingPosition(0),
+    m_updateInterval(16),
+    m_lastFlush(0),
+    m_backend(s_backend)
 {
+    ::ZeroMemory(const_cast<PVOID*>(m_pendingTexts), 
+                 sizeof (m_pendingTexts));
+
     ::ZeroMemory(&m_config, 
                  sizeof (TASKDIALOGCONFIG));
 
@@ -199,14 +318,16 @@ Kerr::TaskDialog::TaskDialog() :
     m_config.dwFlags = TDF_POSITION_RELATIVE_TO_WINDOW;
 }
 
-void Kerr::TaskDialog::SetWindowTitle(ATL::_U_STRINGorID text)
+Kerr::TaskDialog::~TaskDialog()
 {
+    // Frees the heap strings still waiting to be applied. The arena frees the others.
+    ProcessCommands(0, false);
+    DiscardUpdates();
+}
 
-    if (0 == m_hWnd)
-    {
-        CopyStrToWStr(m_config.pszWindowTitle, text.m_lpstr);
-    }
-    else if (IS_INTRESOURCE(text.m_lpstr))
+void Kerr::TaskDialog::SetWindowTitle(ATL::_U_STRINGorID text)
+{
+    if (0 != m_hWnd && IS_INTRESOURCE(text.m_lpstr))
     {
         CString string;
 
@@ -219,90 +340,248 @@ void Kerr::TaskDialog::SetWindowTitle(ATL::_U_STRINGorID text)
 
         #pragma warning(pop)
 
-        VERIFY(SetWindowText(string));
+        VERIFY(m_backend->SendDialogMessage(m_hWnd,
+                                            WM_SETTEXT,
+                                            0,
+                                            reinterpret_cast<LPARAM>(string.GetString())));
     }
     else
     {
-        VERIFY(SetWindowText(text.m_lpstr));
+        SetWindowTitle(ConvertString(text.m_lpstr));
     }
 }
 
 void Kerr::TaskDialog::SetMainInstruction(ATL::_U_STRINGorID text)
 {
-    PCWSTR wstr = NULL;
-    CopyStrToWStr(wstr, text.m_lpstr);
+    SetMainInstruction(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetContent(ATL::_U_STRINGorID text)
+{
+    SetContent(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetVerificationText(ATL::_U_STRINGorID text)
+{
+    SetVerificationText(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetExpandedInformation(ATL::_U_STRINGorID text)
+{
+    SetExpandedInformation(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetExpandedControlText(ATL::_U_STRINGorID text)
+{
+    SetExpandedControlText(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetCollapsedControlText(ATL::_U_STRINGorID text)
+{
+    SetCollapsedControlText(ConvertString(text.m_lpstr));
+}
+
+void Kerr::TaskDialog::SetFooter(ATL::_U_STRINGorID text)
+{
+    SetFooter(ConvertString(text.m_lpstr));
+}
+
+PWSTR Kerr::TaskDialog::AllocString(size_t length)
+{
     if (0 == m_hWnd)
     {
-        m_config.pszMainInstruction = wstr;
+        return m_strings.Allocate(length);
     }
     else
     {
-        SendMessage(TDM_SET_ELEMENT_TEXT,
-                    TDE_MAIN_INSTRUCTION,
-                    reinterpret_cast<LPARAM>(wstr));
+        return new wchar_t[length + 1];
     }
 }
 
-void Kerr::TaskDialog::SetContent(ATL::_U_STRINGorID text)
+// Moves the strings still referenced by the dialog into a new generation of the arena, and frees the previous one.
+// Must be called while the dialog is hidden, on the thread that sets the strings.
+void Kerr::TaskDialog::CompactStrings()
+{
+    ASSERT(0 == m_hWnd);
+
+    // Cheap until the arena has grown enough to be worth compacting
+    if (!m_strings.MayNeedCompacting())
+        return;
+
+    CAtlArray<PCWSTR*> fields;
+    GetStringFields(fields);
+    m_strings.Compact(fields.GetData(),
+                      fields.GetCount());
+}
+
+// Collects the fields of the configuration and of the buttons that point to strings of the arena
+void Kerr::TaskDialog::GetStringFields(CAtlArray<PCWSTR*>& fields)
+{
+    PCWSTR* configFields[] =
+    {
+        &m_config.pszWindowTitle,
+        &m_config.pszMainInstruction,
+        &m_config.pszContent,
+        &m_config.pszVerificationText,
+        &m_config.pszExpandedInformation,
+        &m_config.pszExpandedControlText,
+        &m_config.pszCollapsedControlText,
+        &m_config.pszFooter,
+        0 == (TDF_USE_HICON_MAIN & m_config.dwFlags) ? &m_config.pszMainIcon : NULL,
+        0 == (TDF_USE_HICON_FOOTER & m_config.dwFlags) ? &m_config.pszFooterIcon : NULL
+    };
+
+    for (size_t i = 0; i < _countof(configFields); i++)
+    {
+        if (configFields[i] && m_strings.Owns(*configFields[i]))
+            fields.Add(configFields[i]);
+    }
+    for (size_t i = 0; i < m_buttons.GetCount(); i++)
+    {
+        if (m_strings.Owns(m_buttons[i].pszButtonText))
+            fields.Add(&m_buttons[i].pszButtonText);
+    }
+    for (size_t i = 0; i < m_radioButtons.GetCount(); i++)
+    {
+        if (m_strings.Owns(m_radioButtons[i].pszButtonText))
+            fields.Add(&m_radioButtons[i].pszButtonText);
+    }
+}
+
+// The strings are not copied: `source` must never change again and must outlive this dialog.
+// Setting a property afterwards replaces only that string, leaving the template untouched.
+void Kerr::TaskDialog::UseTemplate(const TaskDialog& source)
+{
+    ASSERT(0 == m_hWnd);
+
+    PFTASKDIALOGCALLBACK callback = m_config.pfCallback;
+    LONG_PTR callbackData = m_config.lpCallbackData;
+    m_config = source.m_config;
+    m_config.pfCallback = callback;
+    m_config.lpCallbackData = callbackData;
+
+    m_buttons.Copy(source.m_buttons);
+    m_radioButtons.Copy(source.m_radioButtons);
+    m_updateInterval = source.m_updateInterval;
+
+    m_pendingMarquee = source.m_pendingMarquee;
+    m_pendingMarqueeSpeed = source.m_pendingMarqueeSpeed;
+    m_pendingState = source.m_pendingState;
+    m_pendingPosition = source.m_pendingPosition;
+    m_progressValues = source.m_progressValues;
+}
+
+PCWSTR Kerr::TaskDialog::ConvertString(const char* text)
+{
+    size_t length = strlen(text);
+    PWSTR wstr = AllocString(length);
+    Utf8::ToUtf16(wstr, text, length);
+    return wstr;
+}
+
+// Makes sure that a string stored in the configuration belongs to the arena
+PCWSTR Kerr::TaskDialog::KeepString(PCWSTR text)
+{
+    if (m_strings.Owns(text))
+        return text;
+
+    PCWSTR copy = m_strings.Copy(text);
+    delete[] text;
+    return copy;
+}
+
+// Makes sure that a string sent to the visible dialog is a heap string.
+// The arena string is reclaimed with the others.
+PCWSTR Kerr::TaskDialog::LiveString(PCWSTR text)
+{
+    if (!m_strings.Owns(text))
+        return text;
+
+    size_t length = wcslen(text);
+    PWSTR copy = new wchar_t[length + 1];
+    wmemcpy(copy, text, length + 1);
+    return copy;
+}
+
+void Kerr::TaskDialog::SetWindowTitle(PCWSTR text)
 {
-    PCWSTR wstr = NULL;
-    CopyStrToWStr(wstr, text.m_lpstr);
     if (0 == m_hWnd)
     {
-        m_config.pszContent = wstr;
+        m_config.pszWindowTitle = KeepString(text);
     }
     else
     {
-        SendMessage(TDM_SET_ELEMENT_TEXT,
-                    TDE_CONTENT,
-                    reinterpret_cast<LPARAM>(wstr));
+        PostCommand(WM_SETTEXT,
+                    0,
+                    0,
+                    LiveString(text));
     }
 }
 
-void Kerr::TaskDialog::SetVerificationText(ATL::_U_STRINGorID text)
+void Kerr::TaskDialog::SetMainInstruction(PCWSTR text)
 {
-    CopyStrToWStr(m_config.pszVerificationText, text.m_lpstr);
+    if (0 == m_hWnd)
+    {
+        m_config.pszMainInstruction = KeepString(text);
+    }
+    else
+    {
+        CombineText(TDE_MAIN_INSTRUCTION,
+                    LiveString(text));
+    }
 }
 
-void Kerr::TaskDialog::SetExpandedInformation(ATL::_U_STRINGorID text)
+void Kerr::TaskDialog::SetContent(PCWSTR text)
 {
-    PCWSTR wstr = NULL;
-    CopyStrToWStr(wstr, text.m_lpstr);
     if (0 == m_hWnd)
     {
-        m_config.pszExpandedInformation = wstr;
+        m_config.pszContent = KeepString(text);
     }
     else
     {
-        SendMessage(TDM_SET_ELEMENT_TEXT,
-                    TDE_EXPANDED_INFORMATION,
-                    reinterpret_cast<LPARAM>(wstr));
+        CombineText(TDE_CONTENT,
+                    LiveString(text));
     }
 }
 
-void Kerr::TaskDialog::SetExpandedControlText(ATL::_U_STRINGorID text)
+void Kerr::TaskDialog::SetVerificationText(PCWSTR text)
 {
-    CopyStrToWStr(m_config.pszExpandedControlText, text.m_lpstr);
+    m_config.pszVerificationText = KeepString(text);
 }
 
-void Kerr::TaskDialog::SetCollapsedControlText(ATL::_U_STRINGorID text)
+void Kerr::TaskDialog::SetExpandedInformation(PCWSTR text)
 {
-    CopyStrToWStr(m_config.pszCollapsedControlText, text.m_lpstr);
+    if (0 == m_hWnd)
+    {
+        m_config.pszExpandedInformation = KeepString(text);
+    }
+    else
+    {
+        CombineText(TDE_EXPANDED_INFORMATION,
+                    LiveString(text));
+    }
 }
 
-void Kerr::TaskDialog::SetFooter(ATL::_U_STRINGorID text)
+void Kerr::TaskDialog::SetExpandedControlText(PCWSTR text)
+{
+    m_config.pszExpandedControlText = KeepString(text);
+}
+
+void Kerr::TaskDialog::SetCollapsedControlText(PCWSTR text)
+{
+    m_config.pszCollapsedControlText = KeepString(text);
+}
+
+void Kerr::TaskDialog::SetFooter(PCWSTR text)
 {
-    PCWSTR wstr = NULL;
-    CopyStrToWStr(wstr, text.m_lpstr);
     if (0 == m_hWnd)
     {
-        m_config.pszFooter = wstr;
+        m_config.pszFooter = KeepString(text);
     }
     else
     {
-        SendMessage(TDM_SET_ELEMENT_TEXT,
-                    TDE_FOOTER,
-                    reinterpret_cast<LPARAM>(wstr));
+        CombineText(TDE_FOOTER,
+                    LiveString(text));
     }
 }
 
@@ -317,9 +596,12 @@ void Kerr::TaskDialog::SetMainIcon(HICON handle)
     {
         ASSERT(TDF_USE_HICON_MAIN & m_config.dwFlags);
 
-        SendMessage(TDM_UPDATE_ICON,
+        // The handle belongs to the caller: waits for the dialog to use it before returning
+        PostCommand(TDM_UPDATE_ICON,
                     TDIE_ICON_MAIN,
                     reinterpret_cast<LPARAM>(handle));
+        m_backend->SendDialogMessage(m_hWnd,
+                                     s_processCommandsMessage);
     }
 }
 
@@ -330,16 +612,26 @@ void Kerr::TaskDialog::SetMainIcon(ATL::_U_STRINGorID resource)
         if (IS_INTRESOURCE(resource.m_lpstr))
             m_config.pszMainIcon = (PCWSTR)resource.m_lpstr;
         else
-            CopyStrToWStr(m_config.pszMainIcon, resource.m_lpstr);
+            m_config.pszMainIcon = KeepString(ConvertString(resource.m_lpstr));
         m_config.dwFlags &= ~TDF_USE_HICON_MAIN;
     }
     else
     {
         ASSERT(0 == (TDF_USE_HICON_MAIN & m_config.dwFlags));
 
-        SendMessage(TDM_UPDATE_ICON,
-                    TDIE_ICON_MAIN,
-                    reinterpret_cast<LPARAM>(resource.m_lpstr));
+        if (IS_INTRESOURCE(resource.m_lpstr))
+        {
+            PostCommand(TDM_UPDATE_ICON,
+                        TDIE_ICON_MAIN,
+                        reinterpret_cast<LPARAM>(resource.m_lpstr));
+        }
+        else
+        {
+            PostCommand(TDM_UPDATE_ICON,
+                        TDIE_ICON_MAIN,
+                        0,
+                        LiveString(ConvertString(resource.m_lpstr)));
+        }
     }
 }
 
@@ -354,9 +646,12 @@ void Kerr::TaskDialog::SetFooterIcon(HICON handle)
     {
         ASSERT(TDF_USE_HICON_FOOTER & m_config.dwFlags);
 
-        SendMessage(TDM_UPDATE_ICON,
+        // The handle belongs to the caller: waits for the dialog to use it before returning
+        PostCommand(TDM_UPDATE_ICON,
                     TDIE_ICON_FOOTER,
                     reinterpret_cast<LPARAM>(handle));
+        m_backend->SendDialogMessage(m_hWnd,
+                                     s_processCommandsMessage);
     }
 }
 
@@ -367,16 +662,26 @@ void Kerr::TaskDialog::SetFooterIcon(ATL::_U_STRINGorID resource)
         if (IS_INTRESOURCE(resource.m_lpstr))
             m_config.pszFooterIcon = (PCWSTR)resource.m_lpstr;
         else
-            CopyStrToWStr(m_config.pszFooterIcon, resource.m_lpstr);
+            m_config.pszFooterIcon = KeepString(ConvertString(resource.m_lpstr));
         m_config.dwFlags &= ~TDF_USE_HICON_FOOTER;
     }
     else
     {
         ASSERT(0 == (TDF_USE_HICON_FOOTER & m_config.dwFlags));
 
-        SendMessage(TDM_UPDATE_ICON,
-                    TDIE_ICON_FOOTER,
-                    reinterpret_cast<LPARAM>(resource.m_lpstr));
+        if (IS_INTRESOURCE(resource.m_lpstr))
+        {
+            PostCommand(TDM_UPDATE_ICON,
+                        TDIE_ICON_FOOTER,
+                        reinterpret_cast<LPARAM>(resource.m_lpstr));
+        }
+        else
+        {
+            PostCommand(TDM_UPDATE_ICON,
+                        TDIE_ICON_FOOTER,
+                        0,
+                        LiveString(ConvertString(resource.m_lpstr)));
+        }
     }
 }
 
@@ -393,17 +698,61 @@ CAtlArray<TASKDIALOG_BUTTON>& Kerr::TaskDialog::RadioButtons()
 void Kerr::TaskDialog::AddButton(ATL::_U_STRINGorID text,
                                  int id)
 {
-    size_t index = m_buttons.Add();
-    CopyStrToWStr(m_buttons[index].pszButtonText, text.m_lpstr);
-    m_buttons[index].nButtonID = id;
+    AddButton(ConvertString(text.m_lpstr),
+              id);
 }
 
 void Kerr::TaskDialog::AddRadioButton(ATL::_U_STRINGorID text,
                                       int id)
 {
-    size_t index = m_radioButtons.Add();
-    CopyStrToWStr(m_radioButtons[index].pszButtonText, text.m_lpstr);
-    m_radioButtons[index].nButtonID = id;
+    AddRadioButton(ConvertString(text.m_lpstr),
+                   id);
+}
+
+void Kerr::TaskDialog::AddButton(PCWSTR text,
+                                 int id)
+{
+    TASKDIALOG_BUTTON button = { id, KeepString(text) };
+    m_buttons.Add(button);
+}
+
+void Kerr::TaskDialog::AddRadioButton(PCWSTR text,
+                                      int id)
+{
+    TASKDIALOG_BUTTON button = { id, KeepString(text) };
+    m_radioButtons.Add(button);
+}
+
+void Kerr::TaskDialog::SetButton(size_t index,
+                                 PCWSTR text,
+                                 int id)
+{
+    ASSERT(index <= m_buttons.GetCount());
+    TASKDIALOG_BUTTON button = { id, KeepString(text) };
+    if (index == m_buttons.GetCount())
+    {
+        m_buttons.Add(button);
+    }
+    else
+    {
+        m_buttons[index] = button;
+    }
+}
+
+void Kerr::TaskDialog::SetRadioButton(size_t index,
+                                      PCWSTR text,
+                                      int id)
+{
+    ASSERT(index <= m_radioButtons.GetCount());
+    TASKDIALOG_BUTTON button = { id, KeepString(text) };
+    if (index == m_radioButtons.GetCount())
+    {
+        m_radioButtons.Add(button);
+    }
+    else
+    {
+        m_radioButtons[index] = button;
+    }
 }
 
 void Kerr::TaskDialog::SetCommonButtons(TASKDIALOG_COMMON_BUTTON_FLAGS commonButtons) {
@@ -469,16 +818,26 @@ HRESULT Kerr::TaskDialog::DoModal(HWND parent)
 {
     ASSERT(0 == m_hWnd);
 
+    // Discards the commands and updates left over by a previous run
+    ProcessCommands(0, false);
+    DiscardUpdates();
+
     m_config.hwndParent = parent;
     m_config.pButtons = m_buttons.GetData();
     m_config.cButtons = static_cast<UINT>(m_buttons.GetCount());
     m_config.pRadioButtons = m_radioButtons.GetData();
     m_config.cRadioButtons = static_cast<UINT>(m_radioButtons.GetCount());
 
-    return ::TaskDialogIndirect(&m_config,
-                                &m_selectedButtonId,
-                                &m_selectedRadioButtonId,
-                                &m_verificationChecked);
+    m_backend = s_backend;
+    return m_backend->ShowDialog(&m_config,
+                                 &m_selectedButtonId,
+                                 &m_selectedRadioButtonId,
+                                 &m_verificationChecked);
+}
+
+void Kerr::TaskDialog::SetBackend(DialogBackend* backend)
+{
+    s_backend = backend ? backend : &s_comctl32Backend;
 }
 
 int Kerr::TaskDialog::GetSelectedButtonId() const
@@ -498,20 +857,20 @@ bool Kerr::TaskDialog::VerificiationChecked() const
 
 void Kerr::TaskDialog::ClickButton(int buttonId)
 {
-    SendMessage(TDM_CLICK_BUTTON,
+    PostCommand(TDM_CLICK_BUTTON,
                 buttonId);
 }
 
 void Kerr::TaskDialog::ClickRadioButton(int buttonId)
 {
-    SendMessage(TDM_CLICK_RADIO_BUTTON,
+    PostCommand(TDM_CLICK_RADIO_BUTTON,
                 buttonId);
 }
 
 void Kerr::TaskDialog::ClickVerification(bool checked, 
                                          bool setKeyFocus)
 {
-    SendMessage(TDM_CLICK_VERIFICATION,
+    PostCommand(TDM_CLICK_VERIFICATION,
                 checked,
                 setKeyFocus);
 }
@@ -519,7 +878,7 @@ void Kerr::TaskDialog::ClickVerification(bool checked,
 void Kerr::TaskDialog::EnableButton(int buttonId, 
                                     bool enable)
 {
-    SendMessage(TDM_ENABLE_BUTTON,
+    PostCommand(TDM_ENABLE_BUTTON,
                 buttonId,
                 enable);
 }
@@ -527,7 +886,7 @@ void Kerr::TaskDialog::EnableButton(int buttonId,
 void Kerr::TaskDialog::EnableRadioButton(int buttonId, 
                                          bool enable)
 {
-    SendMessage(TDM_ENABLE_RADIO_BUTTON,
+    PostCommand(TDM_ENABLE_RADIO_BUTTON,
                 buttonId,
                 enable);
 }
@@ -540,29 +899,27 @@ void Kerr::TaskDialog::SetProgressBarMarquee(bool marquee)
 void Kerr::TaskDialog::SetProgressBarMarquee(bool marquee,
                                              DWORD milliseconds)
 {
-    SendMessage(TDM_SET_MARQUEE_PROGRESS_BAR,
-                marquee);
-    SendMessage(TDM_SET_PROGRESS_BAR_MARQUEE,
-                marquee,
-                milliseconds);
+    m_pendingMarquee = marquee;
+    m_pendingMarqueeSpeed = milliseconds;
+    CombineUpdate(PendingMarquee);
 }
 
 void Kerr::TaskDialog::SetProgressBarState(int state)
 {
-    SendMessage(TDM_SET_PROGRESS_BAR_STATE,
-                state);
+    m_pendingState = state;
+    CombineUpdate(PendingState);
 }
 
 void Kerr::TaskDialog::SetProgressBarPosition(int position)
 {
-    SendMessage(TDM_SET_PROGRESS_BAR_POS,
-                position);
+    m_pendingPosition = position;
+    CombineUpdate(PendingPosition);
 }
 
 void Kerr::TaskDialog::SetProgressBarRange(WORD minRange, 
                                            WORD maxRange)
 {
-    SendMessage(TDM_SET_PROGRESS_BAR_RANGE,
+    PostCommand(TDM_SET_PROGRESS_BAR_RANGE,
                 0,
                 MAKELPARAM(minRange, maxRange));
 }
@@ -570,7 +927,7 @@ void Kerr::TaskDialog::SetProgressBarRange(WORD minRange,
 void Kerr::TaskDialog::SetButtonElevationRequired(int buttonId, 
                                                   bool required)
 {
-    SendMessage(TDM_SET_BUTTON_ELEVATION_REQUIRED_STATE,
+    PostCommand(TDM_SET_BUTTON_ELEVATION_REQUIRED_STATE,
                 buttonId,
                 required);
 }
@@ -579,14 +936,23 @@ void Kerr::TaskDialog::NavigatePage(TaskDialog& newDialog)
 {
     ASSERT(0 == newDialog.m_hWnd);
 
+    newDialog.CompactStrings();
     newDialog.m_config.pButtons = newDialog.m_buttons.GetData();
     newDialog.m_config.cButtons = static_cast<UINT>(newDialog.m_buttons.GetCount());
     newDialog.m_config.pRadioButtons = newDialog.m_radioButtons.GetData();
     newDialog.m_config.cRadioButtons = static_cast<UINT>(newDialog.m_radioButtons.GetCount());
 
-    SendMessage(TDM_NAVIGATE_PAGE,
-                0,
-                reinterpret_cast<LPARAM>(&newDialog.m_config));
+    // Commands and updates queued for this page must not be applied to the new one
+    m_backend->SendDialogMessage(m_hWnd,
+                                 s_processCommandsMessage);
+    DiscardUpdates();
+
+    // The new page is shown by the same backend
+    newDialog.m_backend = m_backend;
+    m_backend->SendDialogMessage(m_hWnd,
+                                 TDM_NAVIGATE_PAGE,
+                                 0,
+                                 reinterpret_cast<LPARAM>(&newDialog.m_config));
 
     this->Detach();
 }
@@ -595,6 +961,189 @@ void Kerr::TaskDialog::ResetTimer() {
     m_resetTimer = true;
 }
 
+void Kerr::TaskDialog::PostCommand(UINT message, 
+                                   WPARAM wParam, 
+                                   LPARAM lParam, 
+                                   PCWSTR text)
+{
+    Command command = { message, wParam, text ? reinterpret_cast<LPARAM>(text) : lParam, text };
+    TraceLog::Instant("PostCommand", message);
+
+    // A single message is enough to process all the commands queued before it is handled.
+    // If the queue is full, lets the dialog thread make room synchronously.
+    // If the dialog is not there anymore, the command is dropped.
+    if (!m_commands.Push(m_backend,
+                         m_hWnd,
+                         s_processCommandsMessage,
+                         command))
+    {
+        delete[] text;
+    }
+}
+
+void Kerr::TaskDialog::ProcessCommands(HWND handle, 
+                                       bool execute)
+{
+    // Commands queued from now on need a new message
+    m_commands.BeginProcessing();
+
+    Command command;
+    while (m_commands.Pop(command))
+    {
+        if (execute)
+        {
+            TraceLog::Begin("SendMessage", command.message);
+            m_backend->SendDialogMessage(handle,
+                                         command.message,
+                                         command.wParam,
+                                         command.lParam);
+            TraceLog::End("SendMessage");
+        }
+        delete[] command.text;
+    }
+}
+
+void Kerr::TaskDialog::SetUpdateInterval(DWORD milliseconds)
+{
+    m_updateInterval = milliseconds;
+}
+
+LONG Kerr::TaskDialog::GetElidedUpdates() const
+{
+    return m_updates.GetElidedUpdates();
+}
+
+void Kerr::TaskDialog::CombineUpdate(PendingUpdate update)
+{
+    // While the dialog is hidden, the value is only stored: it is applied once the dialog is constructed
+    InterlockedOr(&m_progressValues, update);
+    if (0 == m_hWnd)
+        return;
+
+    // The value has already been stored: if the previous one had not been applied yet, it is lost
+    m_updates.Combine(update);
+    RequestUpdatesFlush();
+}
+
+void Kerr::TaskDialog::CombineText(TASKDIALOG_ELEMENTS element, 
+                                   PCWSTR text)
+{
+    PCWSTR previous = static_cast<PCWSTR>(InterlockedExchangePointer(&m_pendingTexts[element], 
+                                                                     const_cast<PWSTR>(text)));
+    if (previous)
+    {
+        delete[] previous;
+        m_updates.CountElided();
+    }
+    RequestUpdatesFlush();
+}
+
+void Kerr::TaskDialog::RequestUpdatesFlush()
+{
+    // Until the flush happens, new values just replace the pending ones
+    m_updates.RequestFlush(m_backend,
+                           m_hWnd,
+                           s_flushUpdatesMessage);
+}
+
+void Kerr::TaskDialog::FlushUpdates(HWND handle)
+{
+    // Applies the updates at most once per interval, postponing them if needed
+    DWORD elapsed = ::GetTickCount() - m_lastFlush;
+    if (elapsed < m_updateInterval)
+    {
+        m_backend->SetDialogTimer(handle,
+                                  s_flushUpdatesTimer,
+                                  m_updateInterval - elapsed);
+        return;
+    }
+    m_backend->KillDialogTimer(handle,
+                               s_flushUpdatesTimer);
+    m_lastFlush = ::GetTickCount();
+    TraceLog::Begin("FlushUpdates");
+
+    // A progress bar range, for instance, must be set before the position it allows
+    ProcessCommands(handle, true);
+
+    // Values set from now on need a new flush
+    LONG pending = m_updates.BeginFlush();
+
+    if (pending & PendingMarquee)
+    {
+        m_backend->SendDialogMessage(handle,
+                                     TDM_SET_MARQUEE_PROGRESS_BAR,
+                                     m_pendingMarquee,
+                                     0);
+        m_backend->SendDialogMessage(handle,
+                                     TDM_SET_PROGRESS_BAR_MARQUEE,
+                                     m_pendingMarquee,
+                                     m_pendingMarqueeSpeed);
+    }
+    if (pending & PendingState)
+    {
+        m_backend->SendDialogMessage(handle,
+                                     TDM_SET_PROGRESS_BAR_STATE,
+                                     m_pendingState,
+                                     0);
+    }
+    if (pending & PendingPosition)
+    {
+        m_backend->SendDialogMessage(handle,
+                                     TDM_SET_PROGRESS_BAR_POS,
+                                     m_pendingPosition,
+                                     0);
+    }
+
+    for (int element = 0; element <= TDE_MAIN_INSTRUCTION; element++)
+    {
+        PCWSTR text = static_cast<PCWSTR>(InterlockedExchangePointer(&m_pendingTexts[element], 
+                                                                     NULL));
+        if (text)
+        {
+            m_backend->SendDialogMessage(handle,
+                                         TDM_SET_ELEMENT_TEXT,
+                                         element,
+                                         reinterpret_cast<LPARAM>(text));
+            delete[] text;
+        }
+    }
+
+    TraceLog::End("FlushUpdates");
+}
+
+void Kerr::TaskDialog::DiscardUpdates()
+{
+    m_updates.Discard();
+    for (int element = 0; element <= TDE_MAIN_INSTRUCTION; element++)
+    {
+        delete[] static_cast<PCWSTR>(InterlockedExchangePointer(&m_pendingTexts[element], 
+                                                                NULL));
+    }
+}
+
+bool Kerr::TaskDialog::CommandsHook(HWND handle, 
+                                    UINT message, 
+                                    WPARAM wParam, 
+                                    LPARAM /*lParam*/, 
+                                    DWORD_PTR data, 
+                                    LRESULT* result)
+{
+    if (s_processCommandsMessage == message)
+    {
+        reinterpret_cast<TaskDialog*>(data)->ProcessCommands(handle, true);
+        *result = TRUE;
+        return true;
+    }
+    if (s_flushUpdatesMessage == message || (WM_TIMER == message && s_flushUpdatesTimer == wParam))
+    {
+        reinterpret_cast<TaskDialog*>(data)->FlushUpdates(handle);
+        *result = 0;
+        return true;
+    }
+
+    return false;
+}
+
 HRESULT Kerr::TaskDialog::Callback(HWND handle, 
                                    UINT notification, 
                                    WPARAM wParam, 
@@ -642,6 +1191,10 @@ HRESULT Kerr::TaskDialog::Callback(HWND handle,
         }
         case TDN_DESTROYED:
         {
+            pThis->m_backend->KillDialogTimer(handle, s_flushUpdatesTimer);
+            pThis->m_backend->RemoveDialogHook(handle, CommandsHook);
+            pThis->ProcessCommands(handle, false);
+            pThis->DiscardUpdates();
             pThis->Detach();
             break;
         }
@@ -656,7 +1209,17 @@ HRESULT Kerr::TaskDialog::Callback(HWND handle,
         }
         case TDN_DIALOG_CONSTRUCTED:
         {
+            // Also sent after a navigation: the hook is then moved to the new page
+            VERIFY(pThis->m_backend->SetDialogHook(handle, CommandsHook, data));
             pThis->Attach(handle);
+
+            // Applies the progress bar values set while the dialog was hidden
+            LONG progressValues = InterlockedOr(&pThis->m_progressValues, 0);
+            if (progressValues)
+            {
+                pThis->m_updates.Reapply(progressValues);
+                pThis->RequestUpdatesFlush();
+            }
             pThis->OnDialogConstructed();
             break;
         }
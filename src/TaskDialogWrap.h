@@ -1,19 +1,21 @@
 #pragma once
 
 #include "JSTaskDialog.h"
+#include "DialogThreadPool.h"
+#include "HeadlessBackend.h"
 
 #include <node.h>
 #include <v8.h>
 
+#include <string.h>
+#include <vector>
+
 using namespace v8;
 
 // ************************************************
 // TaskDialogWrap - Class definition
 // ************************************************
 
-#define PROTOTYPE_PROP_DEF(name) \
-    static Handle<Value> Set##name(const Arguments& args);
-
 class TaskDialogWrap : public node::ObjectWrap {
 
     public:
@@ -26,132 +28,237 @@ class TaskDialogWrap : public node::ObjectWrap {
 
         // Instance members
         JSTaskDialog* _taskDialog;
+        Persistent<Object> _template;
+        uint32_t _unchangedUpdates;
+
+        // Navigation: on the page currently displayed, the page on which `Show` was called (NULL on the hidden pages).
+        // On the latter, the page currently displayed, whose buttons the results refer to.
+        TaskDialogWrap* _firstPage;
+        Persistent<Object> _shownPage;
 
         // Constructor
         static Persistent<Function> _constructor;
         static Persistent<FunctionTemplate> _constructorTemplate;
         static Handle<Value> New(const Arguments& args);
 
-        // Prototype properties implementation
-        PROTOTYPE_PROP_DEF(WindowTitle)
-        PROTOTYPE_PROP_DEF(MainInstruction)
-        PROTOTYPE_PROP_DEF(Content)
-        PROTOTYPE_PROP_DEF(CollapsedControlText)
-        PROTOTYPE_PROP_DEF(ExpandedControlText)
-        PROTOTYPE_PROP_DEF(ExpandedInformation)
-        PROTOTYPE_PROP_DEF(VerificationText)
-        PROTOTYPE_PROP_DEF(Footer)
-
-        PROTOTYPE_PROP_DEF(UseLinks)
-        PROTOTYPE_PROP_DEF(UseCommandLinks)
-        PROTOTYPE_PROP_DEF(UseProgressBar)
-        PROTOTYPE_PROP_DEF(UseTimer)
-        PROTOTYPE_PROP_DEF(Cancelable)
-        PROTOTYPE_PROP_DEF(Minimizable)
-        PROTOTYPE_PROP_DEF(ProgressBarMarquee)
-
-        PROTOTYPE_PROP_DEF(MainIcon)
-        PROTOTYPE_PROP_DEF(FooterIcon)
-        PROTOTYPE_PROP_DEF(ProgressBarState)
-        PROTOTYPE_PROP_DEF(ProgressBarPosition)
+        // Properties, exposed as accessors of the instances.
+        // Each one is described by an entry of `_properties`, telling how its value is checked and converted.
+        // The values are cached in an array stored in the second internal field of the instance,
+        // so that reading a property never involves the dialog.
+        enum PropertyId {
+            PropWindowTitle,
+            PropMainInstruction,
+            PropContent,
+            PropCollapsedControlText,
+            PropExpandedControlText,
+            PropExpandedInformation,
+            PropVerificationText,
+            PropFooter,
+            PropUseLinks,
+            PropUseCommandLinks,
+            PropUseProgressBar,
+            PropUseTimer,
+            PropCancelable,
+            PropMinimizable,
+            PropProgressBarMarquee,
+            PropCoalesceTimer,
+            PropBatchEvents,
+            PropMainIcon,
+            PropFooterIcon,
+            PropProgressBarState,
+            PropProgressBarPosition,
+            PropUpdateInterval,
+            PropButtons,
+            PropRadioButtons,
+            PropertiesCount
+        };
+
+        // Slots of the values array after the properties, holding the captions of the buttons last applied
+        enum CacheSlot {
+            CacheButtonCaptions = PropertiesCount,
+            CacheRadioButtonCaptions,
+            CacheSize
+        };
+        enum PropertyType {
+            TypeString,
+            TypeBool,
+            TypeInt,
+            TypeIcon,
+            TypeProgressBarState,
+            TypeButtons
+        };
+        struct Property {
+            const char* name;
+            PropertyType type;
+            Persistent<String> symbol;
+        };
+        static Property _properties[PropertiesCount];
+
+        // Names accepted by the icon and progress bar state properties
+        struct NamedValue {
+            const char* name;
+            int value;
+        };
+        static const NamedValue _icons[];
+        static const NamedValue _progressBarStates[];
+
+        static Handle<Value> GetProperty(Local<String> property, const AccessorInfo& info);
+        static void SetProperty(Local<String> property, Local<Value> value, const AccessorInfo& info);
+        Handle<Value> ApplyProperty(Handle<Object> handle, int id, Handle<Value> value);
 
         // Prototype methods
         static Handle<Value> Show(const Arguments& args);
-        static Handle<Value> SetButtons(const Arguments& args);
-        static Handle<Value> SetRadioButtons(const Arguments& args);
+        static Handle<Value> SetProperties(const Arguments& args);
         static Handle<Value> ResetTimer(const Arguments& args);
         static Handle<Value> Navigate(const Arguments& args);
+        static Handle<Value> UseTemplate(const Arguments& args);
+        static Handle<Value> GetCoalescedEvents(const Arguments& args);
+        static Handle<Value> GetElidedUpdates(const Arguments& args);
+        static Handle<Value> GetUnchangedUpdates(const Arguments& args);
+        static Handle<Value> SetEventSubscribed(const Arguments& args);
+        static Handle<Value> GetSuppressedEvents(const Arguments& args);
+
+        // Static methods
+        static Handle<Value> SetThreadPoolSize(const Arguments& args);
+        static Handle<Value> SetSharedUIThread(const Arguments& args);
+        static Handle<Value> SetHeadless(const Arguments& args);
+        static Handle<Value> GetStats(const Arguments& args);
+        static Handle<Value> SetTracing(const Arguments& args);
+        static HeadlessBackend _headlessBackend;
 
         // Helpers
+        static Handle<Array> GetValues(Handle<Object> handle);
+        static bool FindNamedValue(const NamedValue* values, Handle<Value> name, int& value);
+        static Handle<Value> PropertyError(const char* message, Handle<String> name);
+        static PCWSTR ToWideString(JSTaskDialog* td, Handle<String> str);
+        const char* ApplyButtons(Handle<Array> values, int id, Handle<Value> value);
         struct Show_Baton {
-            uv_work_t request;
+            DialogWork request;
+            TaskDialogWrap* tdw;
             JSTaskDialog* td;
             Persistent<Function> callback;
         };
-        static void Show_Thread(uv_work_t* req);
-        static void Show_ThreadAfter(uv_work_t* req, int status);
+        static void Show_Thread(DialogWork* req);
+        static void Show_ThreadAfter(DialogWork* req);
+
+        // Results of `Show`, created from a template so that they all share the same shape
+        static Persistent<String> _buttonSymbol;
+        static Persistent<String> _radioSymbol;
+        static Persistent<String> _verificationSymbol;
+        static Persistent<String> _errorSymbol;
+        static Persistent<ObjectTemplate> _resultTemplate;
 };
 
 // ************************************************
 // TaskDialogWrap - Implementation
 // ************************************************
 
-#define PROTOTYPE_PROP(proto, name) \
-    proto->Set(String::NewSymbol("Set" #name), FunctionTemplate::New(TaskDialogWrap::Set##name)->GetFunction());
-
-#define PROTOTYPE_PROP_STRING_IMPL(name) \
-    Handle<Value> TaskDialogWrap::Set##name(const Arguments& args) { \
-        if (args.Length() != 1 || !args[0]->IsString()) \
-            return ThrowException(Exception::TypeError(String::New("Expected only one string argument"))); \
-        JSTaskDialog* td = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog; \
-        String::Utf8Value strJs(args[0]->ToString()); \
-        td->Set##name(*strJs); \
-        return Undefined(); \
-    }
+#define PROPERTY(name, type) \
+    { #name, type },
+
+// Properties of the dialog, in the order of `PropertyId`.
+// SetProperties applies them in this order too.
+TaskDialogWrap::Property TaskDialogWrap::_properties[PropertiesCount] = {
+    PROPERTY(WindowTitle, TypeString)
+    PROPERTY(MainInstruction, TypeString)
+    PROPERTY(Content, TypeString)
+    PROPERTY(CollapsedControlText, TypeString)
+    PROPERTY(ExpandedControlText, TypeString)
+    PROPERTY(ExpandedInformation, TypeString)
+    PROPERTY(VerificationText, TypeString)
+    PROPERTY(Footer, TypeString)
+    PROPERTY(UseLinks, TypeBool)
+    PROPERTY(UseCommandLinks, TypeBool)
+    PROPERTY(UseProgressBar, TypeBool)
+    PROPERTY(UseTimer, TypeBool)
+    PROPERTY(Cancelable, TypeBool)
+    PROPERTY(Minimizable, TypeBool)
+    PROPERTY(ProgressBarMarquee, TypeBool)
+    PROPERTY(CoalesceTimer, TypeBool)
+    PROPERTY(BatchEvents, TypeBool)
+    PROPERTY(MainIcon, TypeIcon)
+    PROPERTY(FooterIcon, TypeIcon)
+    PROPERTY(ProgressBarState, TypeProgressBarState)
+    PROPERTY(ProgressBarPosition, TypeInt)
+    PROPERTY(UpdateInterval, TypeInt)
+    PROPERTY(Buttons, TypeButtons)
+    PROPERTY(RadioButtons, TypeButtons)
+};
 
-#define PROTOTYPE_PROP_BOOL_IMPL(name) \
-    Handle<Value> TaskDialogWrap::Set##name(const Arguments& args) { \
-        if (args.Length() != 1 || !args[0]->IsBoolean()) \
-            return ThrowException(Exception::TypeError(String::New("Expected only one boolean argument"))); \
-        JSTaskDialog* td = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog; \
-        td->Set##name(args[0]->ToBoolean()->BooleanValue()); \
-        return Undefined(); \
-    }
+const TaskDialogWrap::NamedValue TaskDialogWrap::_icons[] = {
+    { "none", 0 },
+    { "warning", -1 },
+    { "error", -2 },
+    { "info", -3 },
+    { "shield", -4 },
+    { NULL, 0 }
+};
 
-#define PROTOTYPE_PROP_INT_IMPL(name) \
-    Handle<Value> TaskDialogWrap::Set##name(const Arguments& args) { \
-        if (args.Length() != 1 || !args[0]->IsNumber()) \
-            return ThrowException(Exception::TypeError(String::New("Expected only one integer argument"))); \
-        JSTaskDialog* td = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog; \
-        td->Set##name(args[0]->ToNumber()->IntegerValue()); \
-        return Undefined(); \
-    }
+const TaskDialogWrap::NamedValue TaskDialogWrap::_progressBarStates[] = {
+    { "normal", PBST_NORMAL },
+    { "error", PBST_ERROR },
+    { "paused", PBST_PAUSED },
+    { NULL, 0 }
+};
 
 // Static initialization
 Persistent<Function> TaskDialogWrap::_constructor;
 Persistent<FunctionTemplate> TaskDialogWrap::_constructorTemplate;
+Persistent<String> TaskDialogWrap::_buttonSymbol;
+Persistent<String> TaskDialogWrap::_radioSymbol;
+Persistent<String> TaskDialogWrap::_verificationSymbol;
+Persistent<String> TaskDialogWrap::_errorSymbol;
+Persistent<ObjectTemplate> TaskDialogWrap::_resultTemplate;
+HeadlessBackend TaskDialogWrap::_headlessBackend;
 Handle<Function> TaskDialogWrap::Init() {
     HandleScope scope;
 
     // Initializes dependencies
     JSTaskDialog::Initialize();
+    DialogThreadPool::Initialize();
 
-    // Prepare constructor template
+    // Prepare constructor template.
+    // The second internal field holds the values of the properties.
     Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
     TaskDialogWrap::_constructorTemplate = Persistent<FunctionTemplate>::New(tpl);
     tpl->SetClassName(String::NewSymbol("TaskDialog"));
-    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    tpl->InstanceTemplate()->SetInternalFieldCount(2);
 
-    // Prototype properties
-    Handle<ObjectTemplate> proto = tpl->PrototypeTemplate();
-    PROTOTYPE_PROP(proto, WindowTitle)
-    PROTOTYPE_PROP(proto, MainInstruction)
-    PROTOTYPE_PROP(proto, Content)
-    PROTOTYPE_PROP(proto, CollapsedControlText)
-    PROTOTYPE_PROP(proto, ExpandedControlText)
-    PROTOTYPE_PROP(proto, ExpandedInformation)
-    PROTOTYPE_PROP(proto, VerificationText)
-    PROTOTYPE_PROP(proto, Footer)
-
-    PROTOTYPE_PROP(proto, UseLinks)
-    PROTOTYPE_PROP(proto, UseCommandLinks)
-    PROTOTYPE_PROP(proto, UseProgressBar)
-    PROTOTYPE_PROP(proto, UseTimer)
-    PROTOTYPE_PROP(proto, Cancelable)
-    PROTOTYPE_PROP(proto, Minimizable)
-    PROTOTYPE_PROP(proto, ProgressBarMarquee)
-    
-    PROTOTYPE_PROP(proto, MainIcon)
-    PROTOTYPE_PROP(proto, FooterIcon)
-    PROTOTYPE_PROP(proto, ProgressBarState)
-    PROTOTYPE_PROP(proto, ProgressBarPosition)
+    // Properties
+    for (int i = 0; i < PropertiesCount; i++) {
+        _properties[i].symbol = Persistent<String>::New(String::NewSymbol(_properties[i].name));
+        tpl->InstanceTemplate()->SetAccessor(_properties[i].symbol, GetProperty, SetProperty, Integer::New(i), DEFAULT, DontDelete);
+    }
+
+    // Results
+    _buttonSymbol = Persistent<String>::New(String::NewSymbol("button"));
+    _radioSymbol = Persistent<String>::New(String::NewSymbol("radio"));
+    _verificationSymbol = Persistent<String>::New(String::NewSymbol("verification"));
+    _errorSymbol = Persistent<String>::New(String::NewSymbol("error"));
+    _resultTemplate = Persistent<ObjectTemplate>::New(ObjectTemplate::New());
+    _resultTemplate->Set(_buttonSymbol, Undefined());
+    _resultTemplate->Set(_radioSymbol, Undefined());
+    _resultTemplate->Set(_verificationSymbol, Undefined());
 
     // Prototype methods
+    Handle<ObjectTemplate> proto = tpl->PrototypeTemplate();
     proto->Set(String::NewSymbol("Show"), FunctionTemplate::New(Show)->GetFunction());
-    proto->Set(String::NewSymbol("SetButtons"), FunctionTemplate::New(SetButtons)->GetFunction());
-    proto->Set(String::NewSymbol("SetRadioButtons"), FunctionTemplate::New(SetRadioButtons)->GetFunction());
+    proto->Set(String::NewSymbol("SetProperties"), FunctionTemplate::New(SetProperties)->GetFunction());
     proto->Set(String::NewSymbol("ResetTimer"), FunctionTemplate::New(ResetTimer)->GetFunction());
     proto->Set(String::NewSymbol("Navigate"), FunctionTemplate::New(Navigate)->GetFunction());
+    proto->Set(String::NewSymbol("UseTemplate"), FunctionTemplate::New(UseTemplate)->GetFunction());
+    proto->Set(String::NewSymbol("GetCoalescedEvents"), FunctionTemplate::New(GetCoalescedEvents)->GetFunction());
+    proto->Set(String::NewSymbol("GetElidedUpdates"), FunctionTemplate::New(GetElidedUpdates)->GetFunction());
+    proto->Set(String::NewSymbol("GetUnchangedUpdates"), FunctionTemplate::New(GetUnchangedUpdates)->GetFunction());
+    proto->Set(String::NewSymbol("SetEventSubscribed"), FunctionTemplate::New(SetEventSubscribed)->GetFunction());
+    proto->Set(String::NewSymbol("GetSuppressedEvents"), FunctionTemplate::New(GetSuppressedEvents)->GetFunction());
+
+    // Static methods
+    tpl->Set(String::NewSymbol("SetThreadPoolSize"), FunctionTemplate::New(SetThreadPoolSize)->GetFunction());
+    tpl->Set(String::NewSymbol("SetSharedUIThread"), FunctionTemplate::New(SetSharedUIThread)->GetFunction());
+    tpl->Set(String::NewSymbol("SetHeadless"), FunctionTemplate::New(SetHeadless)->GetFunction());
+    tpl->Set(String::NewSymbol("GetStats"), FunctionTemplate::New(GetStats)->GetFunction());
+    tpl->Set(String::NewSymbol("SetTracing"), FunctionTemplate::New(SetTracing)->GetFunction());
 
     // Actual constructor function
     _constructor = Persistent<Function>::New(tpl->GetFunction());
@@ -160,13 +267,17 @@ Handle<Function> TaskDialogWrap::Init() {
 
 
 TaskDialogWrap::TaskDialogWrap(JSTaskDialog* td):
-    _taskDialog(td)
+    _taskDialog(td),
+    _unchangedUpdates(0),
+    _firstPage(NULL)
 {
 }
 
 TaskDialogWrap::~TaskDialogWrap() {
     if (_taskDialog)
         delete _taskDialog;
+    _template.Dispose();
+    _shownPage.Dispose();
 }
 
 // Constructor
@@ -186,88 +297,252 @@ Handle<Value> TaskDialogWrap::New(const v8::Arguments& args) {
     JSTaskDialog* td = new JSTaskDialog(Persistent<Function>::New(Handle<Function>::Cast(args[0])));
     TaskDialogWrap* tdw = new TaskDialogWrap(td);
     tdw->Wrap(args.This());
+    args.This()->SetInternalField(1, Array::New(CacheSize));
     return args.This();
 
 }
 
-// Prototype properties implementation
-PROTOTYPE_PROP_STRING_IMPL(WindowTitle)
-PROTOTYPE_PROP_STRING_IMPL(MainInstruction)
-PROTOTYPE_PROP_STRING_IMPL(Content)
-PROTOTYPE_PROP_STRING_IMPL(CollapsedControlText)
-PROTOTYPE_PROP_STRING_IMPL(ExpandedControlText)
-PROTOTYPE_PROP_STRING_IMPL(ExpandedInformation)
-PROTOTYPE_PROP_STRING_IMPL(VerificationText)
-PROTOTYPE_PROP_STRING_IMPL(Footer)
-PROTOTYPE_PROP_BOOL_IMPL(UseLinks)
-PROTOTYPE_PROP_BOOL_IMPL(UseCommandLinks)
-PROTOTYPE_PROP_BOOL_IMPL(UseProgressBar)
-PROTOTYPE_PROP_BOOL_IMPL(UseTimer)
-PROTOTYPE_PROP_BOOL_IMPL(Cancelable)
-PROTOTYPE_PROP_BOOL_IMPL(Minimizable)
-PROTOTYPE_PROP_BOOL_IMPL(ProgressBarMarquee)
-PROTOTYPE_PROP_INT_IMPL(MainIcon)
-PROTOTYPE_PROP_INT_IMPL(FooterIcon)
-PROTOTYPE_PROP_INT_IMPL(ProgressBarState)
-PROTOTYPE_PROP_INT_IMPL(ProgressBarPosition)
-
-//void SetProgressBarRange(WORD minRange = 0, WORD maxRange = 100);
-
-// Prototype methods
+// Properties implementation
 
-Handle<Value> TaskDialogWrap::SetButtons(const Arguments& args) {
-    
-    // Checks arguments
-    if (args.Length() != 1 || !args[0]->IsArray())
-        return ThrowException(Exception::TypeError(String::New("Expected only one array as parameter")));
-    
-    // TaskDialog
-    TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
-    JSTaskDialog* td = tdw->_taskDialog;
+Handle<Value> TaskDialogWrap::GetProperty(Local<String> property, const AccessorInfo& info) {
+    HandleScope scope;
+    return scope.Close(GetValues(info.Holder())->Get(info.Data()->Int32Value()));
+}
 
+void TaskDialogWrap::SetProperty(Local<String> property, Local<Value> value, const AccessorInfo& info) {
     HandleScope scope;
+    TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(info.Holder());
+    Handle<Value> error = tdw->ApplyProperty(info.Holder(), info.Data()->Int32Value(), value);
+    if (!error.IsEmpty())
+        ThrowException(error);
+}
 
-    // Builds the buttons list from the JS array
-    Handle<Array> arr = Handle<Array>::Cast(args[0]);
-    td->Buttons().RemoveAll();
-    td->SetCommonButtons(0);
-    for (int i = 0; i < arr->Length(); i++) {
-        if (!arr->Get(i)->IsArray())
-            return ThrowException(Exception::TypeError(String::New("Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display. Optionally, the third argument can be a boolean indicating whether the button is a message-only button or not.")));
-        Handle<Array> pair = Handle<Array>::Cast(arr->Get(i));
-        if (pair->Length() < 2 || pair->Length() > 3|| !pair->Get(1)->IsString() || (pair->Length() == 3 && !pair->Get(2)->IsBoolean()))
-            return ThrowException(Exception::TypeError(String::New("Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display. Optionally, the third argument can be a boolean indicating whether the button is a message-only button or not.")));
-        String::Utf8Value strVal(pair->Get(1)->ToString());
-        td->AddButton(*strVal, 101 + i + ( pair->Length() != 3 ? 0 : (int)pair->Get(2)->BooleanValue() * 1000 )); // If the button is message-only, increment id by 1000
+// Checks and converts a value, applies it to the dialog and caches it.
+// A valid value equal to the cached one is skipped, so that it is neither converted nor sent to the dialog again.
+// Returns the exception to throw if the value is not valid.
+Handle<Value> TaskDialogWrap::ApplyProperty(Handle<Object> handle, int id, Handle<Value> value) {
+    JSTaskDialog* td = _taskDialog;
+    const Property& property = _properties[id];
+    Handle<Array> values = GetValues(handle);
+
+    // Checks the value, and converts the names to numbers
+    PCWSTR str = NULL;
+    bool flag = false;
+    int number = 0;
+    switch (property.type) {
+        case TypeString:
+            if (!value->IsString())
+                return PropertyError(" must be a string", property.symbol);
+            break;
+        case TypeBool:
+            if (!value->IsBoolean())
+                return PropertyError(" must be a boolean", property.symbol);
+            flag = value->BooleanValue();
+            break;
+        case TypeInt:
+            if (!value->IsNumber())
+                return PropertyError(" must be a number", property.symbol);
+            number = value->Int32Value();
+            break;
+        case TypeIcon: {
+            // The text next to the icon must not be null, otherwise the dialog crashes
+            int text = id == PropMainIcon ? PropMainInstruction : PropFooter;
+            if (values->Get(text)->IsUndefined())
+                return Exception::Error(String::Concat(String::Concat(String::Concat(String::New("Before setting "), property.symbol), String::New(", ensure that ")), String::Concat(_properties[text].symbol, String::New(" has a value"))));
+            if (!FindNamedValue(_icons, value, number))
+                return Exception::Error(String::Concat(String::New("Unknown icon: "), value->ToString()));
+            value = Integer::New(number);
+            break;
+        }
+        case TypeProgressBarState:
+            if (!FindNamedValue(_progressBarStates, value, number))
+                return Exception::Error(String::Concat(String::New("Unknown state: "), value->ToString()));
+            value = Integer::New(number);
+            break;
+        case TypeButtons: {
+            // Buttons arrays can be modified in place, so they are always applied (and diffed entry by entry)
+            const char* error = ApplyButtons(values, id, value);
+            if (error)
+                return Exception::TypeError(String::New(error));
+            break;
+        }
     }
 
-    return scope.Close(Undefined());
+    // Skips a valid value equal to the cached one, before converting any string
+    if (property.type != TypeButtons && values->Get(id)->StrictEquals(value)) {
+        _unchangedUpdates++;
+        return Handle<Value>();
+    }
+    if (property.type == TypeString)
+        str = ToWideString(td, value->ToString());
+
+    // Applies it
+    switch (id) {
+        case PropWindowTitle:           td->SetWindowTitle(str); break;
+        case PropMainInstruction:       td->SetMainInstruction(str); break;
+        case PropContent:               td->SetContent(str); break;
+        case PropCollapsedControlText:  td->SetCollapsedControlText(str); break;
+        case PropExpandedControlText:   td->SetExpandedControlText(str); break;
+        case PropExpandedInformation:   td->SetExpandedInformation(str); break;
+        case PropVerificationText:      td->SetVerificationText(str); break;
+        case PropFooter:                td->SetFooter(str); break;
+        case PropUseLinks:              td->SetUseLinks(flag); break;
+        case PropUseCommandLinks:       td->SetUseCommandLinks(flag); break;
+        case PropUseProgressBar:        td->SetUseProgressBar(flag); break;
+        case PropUseTimer:              td->SetUseTimer(flag); break;
+        case PropCancelable:            td->SetCancelable(flag); break;
+        case PropMinimizable:           td->SetMinimizable(flag); break;
+        case PropProgressBarMarquee:    td->SetProgressBarMarquee(flag); break;
+        case PropCoalesceTimer:         td->SetCoalesceTimer(flag); break;
+        case PropBatchEvents:           td->SetBatchEvents(flag); break;
+        case PropMainIcon:              td->SetMainIcon((ATL::_U_STRINGorID)(UINT)number); break;
+        case PropFooterIcon:            td->SetFooterIcon((ATL::_U_STRINGorID)(UINT)number); break;
+        case PropProgressBarState:      td->SetProgressBarState(number); break;
+        case PropProgressBarPosition:   td->SetProgressBarPosition(number); break;
+        case PropUpdateInterval:        td->SetUpdateInterval(number); break;
+    }
 
+    values->Set(id, value);
+
+    // While the dialog is hidden, replaced strings stay in its arena: they are reclaimed as they pile up,
+    // not only when the dialog is shown
+    if (!_firstPage && (property.type == TypeString || property.type == TypeButtons))
+        td->CompactStrings();
+    return Handle<Value>();
 }
 
-Handle<Value> TaskDialogWrap::SetRadioButtons(const Arguments& args) {
-    
+// Helpers
+
+Handle<Array> TaskDialogWrap::GetValues(Handle<Object> handle) {
+    return Handle<Array>::Cast(handle->GetInternalField(1));
+}
+
+bool TaskDialogWrap::FindNamedValue(const NamedValue* values, Handle<Value> name, int& value) {
+    if (!name->IsString())
+        return false;
+    String::AsciiValue ascii(name);
+    for (int i = 0; values[i].name; i++) {
+        if (strcmp(*ascii, values[i].name) == 0) {
+            value = values[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+Handle<Value> TaskDialogWrap::PropertyError(const char* message, Handle<String> name) {
+    return Exception::TypeError(String::Concat(name, String::New(message)));
+}
+
+// Copies the UTF-16 contents of a JS string straight into a buffer owned by the dialog,
+// without transcoding to UTF-8 and back
+PCWSTR TaskDialogWrap::ToWideString(JSTaskDialog* td, Handle<String> str) {
+    int length = str->Length();
+    PWSTR buffer = td->AllocString(length);
+    str->Write(reinterpret_cast<uint16_t*>(buffer), 0, length, String::NO_NULL_TERMINATION);
+    buffer[length] = L'\0';
+    return buffer;
+}
+
+// Applies a buttons array, comparing it with the one applied last time.
+// Only the buttons whose caption changed are converted again: the others just get their id updated,
+// since it depends on the position and on the message-only flag.
+const char* TaskDialogWrap::ApplyButtons(Handle<Array> values, int id, Handle<Value> value) {
+    JSTaskDialog* td = _taskDialog;
+    bool radio = id == PropRadioButtons;
+    const char* usage = radio ?
+        "Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display" :
+        "Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display. Optionally, the third argument can be a boolean indicating whether the button is a message-only button or not.";
+
     // Checks arguments
-    if (args.Length() != 1 || !args[0]->IsArray())
-        return ThrowException(Exception::TypeError(String::New("Expected only one array as parameter")));
-    
-    // TaskDialog
-    TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
-    JSTaskDialog* td = tdw->_taskDialog;
+    if (!value->IsArray())
+        return radio ? "RadioButtons must be an array" : "Buttons must be an array";
+
+    // Reads and checks the whole JS array first, reading each element only once,
+    // so that an invalid entry leaves the buttons and the captions cache untouched.
+    // The values of the buttons are replaced as a whole, since the dialogs created from a template share them.
+    Handle<Array> arr = Handle<Array>::Cast(value);
+    uint32_t length = arr->Length();
+    Handle<Array> buttonValues = Array::New(length);
+    std::vector<Handle<Value> > newCaptions(length);
+    std::vector<int> buttonIds(length);
+    for (uint32_t i = 0; i < length; i++) {
+        Handle<Value> item = arr->Get(i);
+        Handle<Value> caption;
+        Handle<Value> messageOnly;
+        uint32_t pairLength = 0;
+        if (item->IsArray()) {
+            Handle<Array> pair = Handle<Array>::Cast(item);
+            pairLength = pair->Length();
+            buttonValues->Set(i, pair->Get(0));
+            caption = pair->Get(1);
+            if (pairLength == 3)
+                messageOnly = pair->Get(2);
+        }
+        bool valid = radio ? pairLength == 2 : (pairLength == 2 || (pairLength == 3 && messageOnly->IsBoolean()));
+        if (!valid || !caption->IsString())
+            return usage;
+
+        newCaptions[i] = caption;
+        buttonIds[i] = 101 + i + (pairLength == 3 && messageOnly->BooleanValue() ? 1000 : 0); // If the button is message-only, increment id by 1000
+    }
 
+    // Captions of the buttons currently in the dialog
+    int slot = radio ? CacheRadioButtonCaptions : CacheButtonCaptions;
+    Handle<Value> cached = values->Get(slot);
+    Handle<Array> captions;
+    if (cached->IsArray())
+        captions = Handle<Array>::Cast(cached);
+    else {
+        captions = Array::New();
+        values->Set(slot, captions);
+    }
+
+    // Updates the buttons list
+    CAtlArray<TASKDIALOG_BUTTON>& buttons = radio ? td->RadioButtons() : td->Buttons();
+    size_t current = buttons.GetCount();
+    if (!radio)
+        td->SetCommonButtons(0);
+    for (uint32_t i = 0; i < length; i++) {
+        if (i < current && captions->Get(i)->StrictEquals(newCaptions[i]))
+            buttons[i].nButtonID = buttonIds[i];
+        else {
+            PCWSTR text = ToWideString(td, newCaptions[i]->ToString());
+            if (radio)
+                td->SetRadioButton(i, text, buttonIds[i]);
+            else
+                td->SetButton(i, text, buttonIds[i]);
+            captions->Set(i, newCaptions[i]);
+        }
+    }
+    buttons.SetCount(length);
+    if (radio)
+        td->SetRadioButtonValues(buttonValues);
+    else
+        td->SetButtonValues(buttonValues);
+
+    return NULL;
+}
+
+// Prototype methods
+
+// Applies all the properties of an object in a single call.
+// Properties are looked up from the table, so the object can also contain other ones, which are ignored.
+Handle<Value> TaskDialogWrap::SetProperties(const Arguments& args) {
     HandleScope scope;
 
-    // Builds the buttons list from the JS array
-    Handle<Array> arr = Handle<Array>::Cast(args[0]);
-    td->RadioButtons().RemoveAll();
-    for (int i = 0; i < arr->Length(); i++) {
-        if (!arr->Get(i)->IsArray())
-            return ThrowException(Exception::TypeError(String::New("Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display")));
-        Handle<Array> pair = Handle<Array>::Cast(arr->Get(i));
-        if (pair->Length() != 2 || !pair->Get(1)->IsString())
-            return ThrowException(Exception::TypeError(String::New("Parameter must be an array of arrays, where the first member is a custom value and the second one is the text to display")));
-        String::Utf8Value strVal(pair->Get(1)->ToString());
-        td->AddRadioButton(*strVal, 101 + i);
+    if (args.Length() != 1 || !args[0]->IsObject())
+        return ThrowException(Exception::TypeError(String::New("Expected only one object as parameter")));
+    TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
+    Handle<Object> obj = args[0]->ToObject();
+
+    for (int i = 0; i < PropertiesCount; i++) {
+        Handle<Value> value = obj->Get(_properties[i].symbol);
+        if (value->IsUndefined())
+            continue;
+        Handle<Value> error = tdw->ApplyProperty(args.This(), i, value);
+        if (!error.IsEmpty())
+            return ThrowException(error);
     }
 
     return scope.Close(Undefined());
@@ -285,36 +560,63 @@ Handle<Value> TaskDialogWrap::Show(const Arguments& args) {
     TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
     JSTaskDialog* td = tdw->_taskDialog;
 
+    // Reclaims the strings replaced since the last time the dialog was shown
+    td->CompactStrings();
+
+    // This is the first page, until the dialog navigates to another one
+    tdw->_firstPage = tdw;
+    tdw->_shownPage.Dispose();
+    tdw->_shownPage = Persistent<Object>::New(args.This());
+
     // Schedules the dialog
+    TraceLog::Instant("Show");
     Show_Baton* baton = new Show_Baton();
     baton->request.data = baton;
+    baton->tdw = tdw;
     baton->td = td;
     baton->callback = Persistent<Function>::New(cb);
-    uv_queue_work(uv_default_loop(), &baton->request, TaskDialogWrap::Show_Thread, TaskDialogWrap::Show_ThreadAfter);
+    DialogThreadPool::QueueWork(&baton->request, TaskDialogWrap::Show_Thread, TaskDialogWrap::Show_ThreadAfter);
 
     return scope.Close(Undefined());
 }
 
-void TaskDialogWrap::Show_Thread(uv_work_t* request) {
+void TaskDialogWrap::Show_Thread(DialogWork* request) {
     Show_Baton* baton = (Show_Baton*)request->data;
-    baton->td->DoModal();
+
+    // Dialogs never have an owner: on the shared UI thread, the active window is another dialog,
+    // which would be disabled for as long as this one is open
+    TraceLog::Begin("DoModal");
+    baton->td->DoModal(NULL);
+    TraceLog::End("DoModal");
 }
 
-void TaskDialogWrap::Show_ThreadAfter(uv_work_t* request, int status) {
+void TaskDialogWrap::Show_ThreadAfter(DialogWork* request) {
     HandleScope scope;
 
     Show_Baton* baton = (Show_Baton*)request->data;
+
+    // The ids refer to the buttons of the last page displayed
+    Local<Object> page = Local<Object>::New(baton->tdw->_shownPage);
+    TaskDialogWrap* tdwPage = node::ObjectWrap::Unwrap<TaskDialogWrap>(page);
+    tdwPage->_firstPage = NULL;
+    baton->tdw->_shownPage.Dispose();
+    baton->tdw->_shownPage.Clear();
+
     if (!baton->callback.IsEmpty()) {
 
         // Creates a new object to hold the results
-        Handle<Object> obj = Object::New();
-        obj->Set(String::NewSymbol("button"), Integer::New(baton->td->GetSelectedButtonId()));
-        obj->Set(String::NewSymbol("radio"), Integer::New(baton->td->GetSelectedRadioButtonId()));
-        obj->Set(String::NewSymbol("verification"), Boolean::New(baton->td->VerificiationChecked()));
-
-        // Calls the callback with that object
-        Handle<Value> argv[] = { obj };
-        baton->callback->Call(Context::GetCurrent()->Global(), 1, argv);
+        Handle<Object> obj = _resultTemplate->NewInstance();
+        obj->Set(_buttonSymbol, tdwPage->_taskDialog->GetButtonValue(baton->td->GetSelectedButtonId()));
+        obj->Set(_radioSymbol, tdwPage->_taskDialog->GetRadioButtonValue(baton->td->GetSelectedRadioButtonId()));
+        obj->Set(_verificationSymbol, Boolean::New(baton->td->VerificiationChecked()));
+        if (request->status != 0)
+            obj->Set(_errorSymbol, Exception::Error(String::New("No thread could be created to show the dialog")));
+
+        // Calls the callback with that object and the last page
+        Handle<Value> argv[] = { obj, page };
+        TraceLog::Begin("Show callback");
+        JSTaskDialog::InvokeCallback(baton->callback, 2, argv);
+        TraceLog::End("Show callback");
 
     }
 
@@ -331,11 +633,148 @@ Handle<Value> TaskDialogWrap::ResetTimer(const Arguments& args) {
 Handle<Value> TaskDialogWrap::Navigate(const Arguments& args) {
     if (args.Length() != 1 || !args[0]->IsObject() || args[0]->ToObject()->FindInstanceInPrototypeChain(TaskDialogWrap::_constructorTemplate).IsEmpty())
         return ThrowException(Exception::TypeError(String::New("Expected only one TaskDialog as argument")));
-    JSTaskDialog* tdThis = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog;
-    JSTaskDialog* tdDest = node::ObjectWrap::Unwrap<TaskDialogWrap>(args[0]->ToObject())->_taskDialog;
-    tdThis->NavigatePage(*tdDest);
+    TaskDialogWrap* tdwThis = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
+    TaskDialogWrap* tdwDest = node::ObjectWrap::Unwrap<TaskDialogWrap>(args[0]->ToObject());
+    tdwThis->_taskDialog->NavigatePage(*tdwDest->_taskDialog);
+
+    // Tells the first page which page is now displayed
+    TaskDialogWrap* first = tdwThis->_firstPage ? tdwThis->_firstPage : tdwThis;
+    tdwThis->_firstPage = NULL;
+    tdwDest->_firstPage = first;
+    first->_shownPage.Dispose();
+    first->_shownPage = Persistent<Object>::New(args[0]->ToObject());
+    return Undefined();
+}
+
+// Makes this dialog share the configuration of another one, that must never change again.
+// The template is kept alive for as long as this dialog, since its strings are not copied.
+Handle<Value> TaskDialogWrap::UseTemplate(const Arguments& args) {
+    if (args.Length() != 1 || !args[0]->IsObject() || args[0]->ToObject()->FindInstanceInPrototypeChain(TaskDialogWrap::_constructorTemplate).IsEmpty())
+        return ThrowException(Exception::TypeError(String::New("Expected only one TaskDialog as argument")));
+    TaskDialogWrap* tdw = node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This());
+    JSTaskDialog* tdTemplate = node::ObjectWrap::Unwrap<TaskDialogWrap>(args[0]->ToObject())->_taskDialog;
+    tdw->_taskDialog->UseTemplate(*tdTemplate);
+
+    // Also takes the cached values of the properties.
+    // The captions of the buttons are not taken, so the first buttons applied to this dialog are converted again
+    // instead of changing the template's cache.
+    Handle<Array> values = GetValues(args.This());
+    Handle<Array> templateValues = GetValues(args[0]->ToObject());
+    for (int i = 0; i < PropertiesCount; i++)
+        values->Set(i, templateValues->Get(i));
+
+    tdw->_template.Dispose();
+    tdw->_template = Persistent<Object>::New(args[0]->ToObject());
+    return Undefined();
+}
+
+Handle<Value> TaskDialogWrap::GetCoalescedEvents(const Arguments& args) {
+    return Integer::New(node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog->GetCoalescedEvents());
+}
+
+Handle<Value> TaskDialogWrap::GetElidedUpdates(const Arguments& args) {
+    return Integer::New(node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog->GetElidedUpdates());
+}
+
+Handle<Value> TaskDialogWrap::GetUnchangedUpdates(const Arguments& args) {
+    return Integer::NewFromUnsigned(node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_unchangedUpdates);
+}
+
+// Tells whether an event has listeners. Names of events that the dialog never raises are ignored.
+Handle<Value> TaskDialogWrap::SetEventSubscribed(const Arguments& args) {
+    if (args.Length() != 2 || !args[0]->IsString() || !args[1]->IsBoolean())
+        return ThrowException(Exception::TypeError(String::New("Expected an event name and a boolean as arguments")));
+    String::AsciiValue eventName(args[0]);
+    node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog->SetEventSubscribed(*eventName, args[1]->BooleanValue());
     return Undefined();
 }
 
-#undef PROTOTYPE_PROP_STRING
-#undef PROTOTYPE_PROP_STRING_IMPL
\ No newline at end of file
+Handle<Value> TaskDialogWrap::GetSuppressedEvents(const Arguments& args) {
+    return Integer::New(node::ObjectWrap::Unwrap<TaskDialogWrap>(args.This())->_taskDialog->GetSuppressedEvents());
+}
+
+// Static methods
+
+Handle<Value> TaskDialogWrap::SetThreadPoolSize(const Arguments& args) {
+    if (args.Length() != 1 || !args[0]->IsNumber())
+        return ThrowException(Exception::TypeError(String::New("Expected only one integer argument")));
+    DialogThreadPool::SetMaxThreads((int)args[0]->ToNumber()->IntegerValue());
+    return Undefined();
+}
+
+Handle<Value> TaskDialogWrap::SetSharedUIThread(const Arguments& args) {
+    if (args.Length() != 1 || !args[0]->IsBoolean())
+        return ThrowException(Exception::TypeError(String::New("Expected only one boolean argument")));
+    DialogThreadPool::SetSharedThread(args[0]->ToBoolean()->BooleanValue());
+    return Undefined();
+}
+
+// Replaces the dialogs shown from now on with headless ones, following the schedule in the given object,
+// or restores the real dialogs if the argument is false
+Handle<Value> TaskDialogWrap::SetHeadless(const Arguments& args) {
+    HandleScope scope;
+
+    if (args.Length() != 1 || !(args[0]->IsObject() || args[0]->IsFalse()))
+        return ThrowException(Exception::TypeError(String::New("Expected an object or false as argument")));
+    if (args[0]->IsFalse()) {
+        Kerr::TaskDialog::SetBackend(NULL);
+        return scope.Close(Undefined());
+    }
+
+    // Missing values keep their current setting
+    Handle<Object> schedule = args[0]->ToObject();
+    Handle<Value> value = schedule->Get(String::NewSymbol("TimerInterval"));
+    if (value->IsNumber())
+        _headlessBackend.SetTimerInterval(value->Uint32Value());
+    value = schedule->Get(String::NewSymbol("ClickInterval"));
+    if (value->IsNumber())
+        _headlessBackend.SetClickInterval(value->Uint32Value());
+    value = schedule->Get(String::NewSymbol("ClickButton"));
+    if (value->IsNumber())
+        _headlessBackend.SetClickButton(value->Uint32Value());
+    value = schedule->Get(String::NewSymbol("CloseAfter"));
+    if (value->IsNumber())
+        _headlessBackend.SetCloseAfter(value->Uint32Value());
+
+    Kerr::TaskDialog::SetBackend(&_headlessBackend);
+    return scope.Close(Undefined());
+}
+
+// Snapshot of the load of the whole process: dialog threads, dialogs, event queue and event latencies
+Handle<Value> TaskDialogWrap::GetStats(const Arguments& args) {
+    HandleScope scope;
+
+    DialogThreadPoolStats pool;
+    DialogThreadPool::GetStats(pool);
+
+    Handle<Object> stats = Object::New();
+    stats->Set(String::NewSymbol("Threads"), Integer::New(pool.threads));
+    stats->Set(String::NewSymbol("IdleThreads"), Integer::New(pool.idleThreads));
+    stats->Set(String::NewSymbol("Dialogs"), Integer::New(pool.dialogs));
+    stats->Set(String::NewSymbol("WaitingDialogs"), Integer::New(pool.waitingDialogs));
+    stats->Set(String::NewSymbol("QueuedEvents"), Integer::New(JSTaskDialog::GetQueuedEvents()));
+    stats->Set(String::NewSymbol("DroppedEvents"), Integer::New(JSTaskDialog::GetDroppedEvents()));
+    stats->Set(String::NewSymbol("OverflowEvents"), Integer::New(JSTaskDialog::GetOverflowEvents()));
+    stats->Set(String::NewSymbol("QueueHighWater"), Integer::New(JSTaskDialog::GetQueueHighWater()));
+    stats->Set(String::NewSymbol("Events"), JSTaskDialog::GetEventStats());
+    return scope.Close(stats);
+}
+
+// Starts writing a Chrome trace of the dialogs to the given file, or stops if the argument is false
+Handle<Value> TaskDialogWrap::SetTracing(const Arguments& args) {
+    HandleScope scope;
+
+    if (args.Length() != 1 || !(args[0]->IsString() || args[0]->IsFalse()))
+        return ThrowException(Exception::TypeError(String::New("Expected a file name or false as argument")));
+    if (args[0]->IsFalse()) {
+        TraceLog::Stop();
+        return scope.Close(Undefined());
+    }
+
+    String::Value path(args[0]);
+    if (!TraceLog::Start(reinterpret_cast<const wchar_t*>(*path)))
+        return ThrowException(Exception::Error(String::Concat(String::New("Cannot write the trace to "), args[0]->ToString())));
+    return scope.Close(Undefined());
+}
+
+#undef PROPERTY
@@ -0,0 +1,277 @@
+#pragma once
+
+#include "Platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <uv.h>
+
+// ************************************************
+// TraceLog - Class definition
+// ************************************************
+
+// Opt-in timeline of the dialogs, written as a Chrome trace (chrome://tracing, "JSON array format").
+// Each thread records its events in a buffer of its own, a ring with a single producer (the thread) and a single
+// consumer (the main thread), so recording takes no lock and never waits.
+// The main thread periodically moves the recorded events to the file, outside of any dialog or event dispatch.
+// Events are identified by static strings, which are never copied.
+// When tracing is off, recording an event costs a single read.
+class TraceLog {
+
+    public:
+
+        static const int NoArg = -1;
+
+        // Must be called on the main thread
+        static bool Start(const wchar_t* path);
+        static void Stop();
+
+        // Can be called from any thread
+        static void Begin(const char* name, int arg = NoArg);
+        static void End(const char* name);
+        static void Instant(const char* name, int arg = NoArg);
+
+    private:
+
+        struct Event {
+            const char* name;
+            char phase;
+            int arg;
+            uint64_t timestamp;
+        };
+
+        // Buffers are created the first time a thread records an event, and are reused by the next sessions
+        // while the thread lives. A thread releases its buffer when it exits, and the main thread frees the released
+        // buffers once it has written their events. At most MaxBuffers exist at once: the events of further threads
+        // are dropped.
+        static const LONG BufferCapacity = 4096;
+        static const LONG MaxBuffers = 64;
+        struct Buffer {
+            Buffer* next;
+            DWORD threadId;
+            bool named;
+            volatile LONG owned;    // FALSE once the thread has exited
+            volatile LONG written;
+            volatile LONG flushed;
+            Event events[BufferCapacity];
+        };
+
+        static volatile LONG _enabled;
+        static volatile LONG _droppedEvents;
+        static Buffer* volatile _buffers;
+        static volatile LONG _buffersCount;
+        static DWORD _flsIndex;
+        static DWORD _mainThreadId;
+        static FILE* _file;
+        static bool _firstEvent;
+        static uv_timer_t _flushTimer;
+        static bool _flushTimerInitialized;
+
+        static void Record(const char* name, char phase, int arg);
+        static Buffer* GetBuffer();
+        static VOID WINAPI ReleaseBuffer(PVOID buffer);
+        static bool IsReleased(Buffer* buffer);
+        static void FreeReleasedBuffers();
+        static void Flush();
+        static void FlushTimerHandler(uv_timer_t* handle, int status);
+        static void WriteSeparator();
+};
+
+// ************************************************
+// TraceLog - Implementation
+// ************************************************
+
+volatile LONG TraceLog::_enabled = FALSE;
+volatile LONG TraceLog::_droppedEvents = 0;
+TraceLog::Buffer* volatile TraceLog::_buffers = NULL;
+volatile LONG TraceLog::_buffersCount = 0;
+DWORD TraceLog::_flsIndex = FlsAlloc(TraceLog::ReleaseBuffer);
+DWORD TraceLog::_mainThreadId = 0;
+FILE* TraceLog::_file = NULL;
+bool TraceLog::_firstEvent = true;
+uv_timer_t TraceLog::_flushTimer;
+bool TraceLog::_flushTimerInitialized = false;
+
+// Starts writing the events to a new file, replacing the current one if tracing was already on.
+// The flush timer is unreferenced, so that tracing never keeps the process alive.
+bool TraceLog::Start(const wchar_t* path) {
+    Stop();
+    _file = _wfopen(path, L"w");
+    if (!_file)
+        return false;
+    fputs("[", _file);
+    _firstEvent = true;
+    _mainThreadId = GetCurrentThreadId();
+
+    // Skips the events left in the buffers by a previous session
+    for (Buffer* buffer = _buffers; buffer; buffer = buffer->next) {
+        buffer->flushed = buffer->written;
+        buffer->named = false;
+    }
+
+    if (!_flushTimerInitialized) {
+        uv_timer_init(uv_default_loop(), &_flushTimer);
+        uv_unref((uv_handle_t*)&_flushTimer);
+        _flushTimerInitialized = true;
+    }
+    uv_timer_start(&_flushTimer, TraceLog::FlushTimerHandler, 100, 100);
+
+    InterlockedExchange(&_enabled, TRUE);
+    return true;
+}
+
+// Writes the events recorded so far and closes the file
+void TraceLog::Stop() {
+    if (!_file)
+        return;
+    InterlockedExchange(&_enabled, FALSE);
+    uv_timer_stop(&_flushTimer);
+    Flush();
+    FreeReleasedBuffers();
+    if (_droppedEvents) {
+        WriteSeparator();
+        fprintf(_file, "{\"name\":\"DroppedEvents\",\"ph\":\"i\",\"s\":\"g\",\"ts\":0,\"pid\":%lu,\"tid\":%lu,\"args\":{\"value\":%ld}}",
+                GetCurrentProcessId(), _mainThreadId, _droppedEvents);
+        InterlockedExchange(&_droppedEvents, 0);
+    }
+    fputs("\n]\n", _file);
+    fclose(_file);
+    _file = NULL;
+}
+
+void TraceLog::Begin(const char* name, int arg) {
+    if (_enabled)
+        Record(name, 'B', arg);
+}
+
+void TraceLog::End(const char* name) {
+    if (_enabled)
+        Record(name, 'E', NoArg);
+}
+
+void TraceLog::Instant(const char* name, int arg) {
+    if (_enabled)
+        Record(name, 'i', arg);
+}
+
+// If the buffer is full, the event is dropped rather than waiting for the main thread
+void TraceLog::Record(const char* name, char phase, int arg) {
+    Buffer* buffer = GetBuffer();
+    if (!buffer || buffer->written - buffer->flushed >= BufferCapacity) {
+        InterlockedIncrement(&_droppedEvents);
+        return;
+    }
+
+    Event& event = buffer->events[buffer->written & (BufferCapacity - 1)];
+    event.name = name;
+    event.phase = phase;
+    event.arg = arg;
+    event.timestamp = uv_hrtime();
+
+    // Publishes the event to the main thread
+    buffer->written++;
+}
+
+// The buffer is kept in fiber local storage rather than thread local storage, for its callback on thread exit
+TraceLog::Buffer* TraceLog::GetBuffer() {
+    Buffer* buffer = static_cast<Buffer*>(FlsGetValue(_flsIndex));
+    if (buffer)
+        return buffer;
+
+    if (InterlockedIncrement(&_buffersCount) > MaxBuffers) {
+        InterlockedDecrement(&_buffersCount);
+        return NULL;
+    }
+    buffer = static_cast<Buffer*>(malloc(sizeof(Buffer)));
+    if (!buffer) {
+        InterlockedDecrement(&_buffersCount);
+        return NULL;
+    }
+    buffer->threadId = GetCurrentThreadId();
+    buffer->named = false;
+    buffer->owned = TRUE;
+    buffer->written = 0;
+    buffer->flushed = 0;
+    FlsSetValue(_flsIndex, buffer);
+
+    // Adds the buffer to the list read by the main thread
+    Buffer* head;
+    do {
+        head = _buffers;
+        buffer->next = head;
+    } while (InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&_buffers), buffer, head) != head);
+    return buffer;
+}
+
+// Called on a thread that exits. The buffer stays in the list until the main thread has written its events.
+VOID WINAPI TraceLog::ReleaseBuffer(PVOID buffer) {
+    if (buffer)
+        StoreRelease(static_cast<Buffer*>(buffer)->owned, (LONG)FALSE);
+}
+
+// A thread may still have recorded events between the last flush and its exit: they are written by the next one
+bool TraceLog::IsReleased(Buffer* buffer) {
+    return !LoadAcquire(buffer->owned) && buffer->flushed == buffer->written;
+}
+
+// Frees the buffers of the threads that have exited, once their events are written. Called on the main thread only.
+// Other threads only ever add buffers at the head of the list: the head is unlinked with a compare-exchange,
+// and the other links are only written here.
+void TraceLog::FreeReleasedBuffers() {
+    Buffer* head;
+    while ((head = _buffers) && IsReleased(head)
+           && InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(&_buffers), head->next, head) == head) {
+        free(head);
+        InterlockedDecrement(&_buffersCount);
+    }
+
+    for (Buffer* previous = _buffers; previous && previous->next;) {
+        Buffer* buffer = previous->next;
+        if (!IsReleased(buffer)) {
+            previous = buffer;
+            continue;
+        }
+        previous->next = buffer->next;
+        free(buffer);
+        InterlockedDecrement(&_buffersCount);
+    }
+}
+
+// Moves the recorded events to the file. Called on the main thread only.
+void TraceLog::Flush() {
+    DWORD processId = GetCurrentProcessId();
+    for (Buffer* buffer = _buffers; buffer; buffer = buffer->next) {
+        LONG written = buffer->written;
+        if (buffer->flushed == written)
+            continue;
+
+        // Names the thread the first time it shows up
+        if (!buffer->named) {
+            WriteSeparator();
+            fprintf(_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                    processId, buffer->threadId, buffer->threadId == _mainThreadId ? "Main thread" : "Dialog thread");
+            buffer->named = true;
+        }
+
+        for (; buffer->flushed != written; buffer->flushed++) {
+            const Event& event = buffer->events[buffer->flushed & (BufferCapacity - 1)];
+            WriteSeparator();
+            fprintf(_file, "{\"name\":\"%s\",\"cat\":\"taskdialog\",\"ph\":\"%c\",%s\"ts\":%llu.%03u,\"pid\":%lu,\"tid\":%lu",
+                    event.name, event.phase, event.phase == 'i' ? "\"s\":\"t\"," : "",
+                    event.timestamp / 1000, (unsigned)(event.timestamp % 1000), processId, buffer->threadId);
+            if (event.arg != NoArg)
+                fprintf(_file, ",\"args\":{\"value\":%d}", event.arg);
+            fputs("}", _file);
+        }
+    }
+    fflush(_file);
+}
+
+void TraceLog::FlushTimerHandler(uv_timer_t* handle, int status) {
+    Flush();
+    FreeReleasedBuffers();
+}
+
+void TraceLog::WriteSeparator() {
+    fputs(_firstEvent ? "\n" : ",\n", _file);
+    _firstEvent = false;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "AsyncEventQueue.h"
+#include "DialogBackend.h"
+
+// ************************************************
+// CommandQueue - Class definition
+// ************************************************
+
+// Commands for a visible dialog, queued by any thread and processed in order by the dialog thread.
+// Instead of blocking the calling thread with a SendMessage until the dialog thread handles it, each command is
+// queued, and a single message is posted to make the dialog thread process all the commands queued before it.
+// Does not depend on ATL: Kerr::TaskDialog and the benchmarks share it.
+template<typename T, LONG Capacity>
+class CommandQueue {
+
+    public:
+
+        CommandQueue();
+
+        // Queues a command for the dialog, and posts it `message` unless a previous one is still waiting.
+        // If the queue is full, sends it `message` to make room synchronously.
+        // Returns false, without queueing the command, if the dialog is not there anymore.
+        bool Push(DialogBackend* backend, HWND handle, UINT message, const T& command);
+
+        // Called by the dialog thread when it handles `message`, before taking the commands:
+        // the ones queued from then on need a new message
+        void BeginProcessing();
+        bool Pop(T& command);
+
+    private:
+
+        AsyncEventQueue<T, Capacity> _commands;
+        volatile LONG _posted;
+
+        CommandQueue(const CommandQueue&);
+        CommandQueue& operator=(const CommandQueue&);
+};
+
+// ************************************************
+// UpdateCombiner - Class definition
+// ************************************************
+
+// Write-combining of the updates of a visible dialog, such as the position of its progress bar.
+// The caller keeps only the latest value of each update, and marks it as pending here: a single message is posted
+// to make the dialog thread apply all the pending updates, and values replaced before that are counted as elided.
+// Updates are identified by bits.
+class UpdateCombiner {
+
+    public:
+
+        UpdateCombiner();
+
+        // Marks updates as pending, once their new values have been stored
+        void Combine(LONG updates);
+
+        // Marks updates as pending again, to apply values already applied before, without counting them as elided
+        void Reapply(LONG updates);
+
+        // Counts a value replaced before being applied, for the updates whose pending state is kept by the caller
+        void CountElided();
+
+        // Posts `message` to the dialog unless a previous one is still waiting
+        void RequestFlush(DialogBackend* backend, HWND handle, UINT message);
+
+        // Called by the dialog thread when it handles `message`: returns the pending updates and clears them,
+        // so that the values set from then on need a new flush
+        LONG BeginFlush();
+
+        // Forgets the pending updates
+        void Discard();
+
+        LONG GetElidedUpdates() const;
+
+    private:
+
+        volatile LONG _pending;
+        volatile LONG _posted;
+        volatile LONG _elided;
+};
+
+// ************************************************
+// CommandQueue - Implementation
+// ************************************************
+
+template<typename T, LONG Capacity>
+CommandQueue<T, Capacity>::CommandQueue() :
+    _posted(FALSE)
+{
+}
+
+template<typename T, LONG Capacity>
+bool CommandQueue<T, Capacity>::Push(DialogBackend* backend, HWND handle, UINT message, const T& command) {
+    while (!_commands.Push(command)) {
+        if (!backend->SendDialogMessage(handle, message))
+            return false;
+    }
+    if (FALSE == InterlockedExchange(&_posted, TRUE))
+        backend->PostDialogMessage(handle, message);
+    return true;
+}
+
+template<typename T, LONG Capacity>
+void CommandQueue<T, Capacity>::BeginProcessing() {
+    InterlockedExchange(&_posted, FALSE);
+}
+
+template<typename T, LONG Capacity>
+bool CommandQueue<T, Capacity>::Pop(T& command) {
+    return _commands.Pop(command);
+}
+
+// ************************************************
+// UpdateCombiner - Implementation
+// ************************************************
+
+UpdateCombiner::UpdateCombiner() :
+    _pending(0),
+    _posted(FALSE),
+    _elided(0)
+{
+}
+
+// A value already pending has been overwritten by the new one before being applied
+void UpdateCombiner::Combine(LONG updates) {
+    if (InterlockedOr(&_pending, updates) & updates)
+        InterlockedIncrement(&_elided);
+}
+
+void UpdateCombiner::Reapply(LONG updates) {
+    InterlockedOr(&_pending, updates);
+}
+
+void UpdateCombiner::CountElided() {
+    InterlockedIncrement(&_elided);
+}
+
+void UpdateCombiner::RequestFlush(DialogBackend* backend, HWND handle, UINT message) {
+    if (FALSE == InterlockedExchange(&_posted, TRUE))
+        backend->PostDialogMessage(handle, message);
+}
+
+LONG UpdateCombiner::BeginFlush() {
+    InterlockedExchange(&_posted, FALSE);
+    return InterlockedExchange(&_pending, 0);
+}
+
+void UpdateCombiner::Discard() {
+    BeginFlush();
+}
+
+LONG UpdateCombiner::GetElidedUpdates() const {
+    return _elided;
+}
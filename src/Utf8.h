@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+#include <wchar.h>
+
+// SSE2 is used to widen runs of ASCII characters 16 at a time, unless UTF8_NO_SSE2 is defined
+#if !defined UTF8_NO_SSE2 && (defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2) || defined __SSE2__)
+    #define UTF8_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+// ************************************************
+// Utf8 - UTF-8 to UTF-16 transcoding
+// ************************************************
+
+namespace Utf8
+{
+    // Decodes `length` bytes of UTF-8 from `source` directly into `dest`, in a single pass, and terminates it with a null character.
+    // The result is UTF-16 even where `wchar_t` has 32 bits (the tests and benchmarks built on other platforms).
+    // A UTF-8 string never needs more UTF-16 code units than it has bytes, so `dest` must have room for `length + 1` characters.
+    // Invalid or truncated sequences, overlong encodings and surrogates are replaced with U+FFFD,
+    // following the Unicode recommendation of one replacement character per maximal invalid subpart.
+    // Returns the number of characters written, excluding the terminator.
+    inline size_t ToUtf16(wchar_t* dest, const char* source, size_t length)
+    {
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(source);
+        size_t i = 0;
+        size_t n = 0;
+
+        while (i < length)
+        {
+
+#if defined UTF8_USE_SSE2
+            // ASCII fast path: 16 bytes without the high bit set become 16 characters
+            while (i + 16 <= length)
+            {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                if (_mm_movemask_epi8(chunk) != 0)
+                    break;
+                __m128i zero = _mm_setzero_si128();
+#if WCHAR_MAX > 0xFFFF
+                __m128i low = _mm_unpacklo_epi8(chunk, zero);
+                __m128i high = _mm_unpackhi_epi8(chunk, zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_unpacklo_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 4), _mm_unpackhi_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 8), _mm_unpacklo_epi16(high, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 12), _mm_unpackhi_epi16(high, zero));
+#else
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_unpacklo_epi8(chunk, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 8), _mm_unpackhi_epi8(chunk, zero));
+#endif
+                i += 16;
+                n += 16;
+            }
+            if (i >= length)
+                break;
+#endif
+
+            unsigned int c = src[i];
+            if (c < 0x80)
+            {
+                dest[n++] = static_cast<wchar_t>(c);
+                i++;
+                continue;
+            }
+
+            // Lead byte: number of continuation bytes, and allowed range of the first one.
+            // Restricting the first continuation byte rules out overlong encodings, surrogates and code points above U+10FFFF.
+            unsigned int codePoint;
+            size_t extra;
+            unsigned int low = 0x80;
+            unsigned int high = 0xBF;
+            if (c >= 0xC2 && c <= 0xDF)
+            {
+                codePoint = c & 0x1F;
+                extra = 1;
+            }
+            else if (c >= 0xE0 && c <= 0xEF)
+            {
+                codePoint = c & 0x0F;
+                extra = 2;
+                if (c == 0xE0)
+                    low = 0xA0;
+                else if (c == 0xED)
+                    high = 0x9F;
+            }
+            else if (c >= 0xF0 && c <= 0xF4)
+            {
+                codePoint = c & 0x07;
+                extra = 3;
+                if (c == 0xF0)
+                    low = 0x90;
+                else if (c == 0xF4)
+                    high = 0x8F;
+            }
+            else
+            {
+                dest[n++] = 0xFFFD;
+                i++;
+                continue;
+            }
+
+            // Continuation bytes. An invalid or truncated sequence is replaced by a single U+FFFD
+            // covering its longest valid prefix, and decoding resumes on the offending byte.
+            size_t j = 1;
+            for (; j <= extra && i + j < length; j++)
+            {
+                unsigned int next = src[i + j];
+                if (next < low || next > high)
+                    break;
+                codePoint = (codePoint << 6) | (next & 0x3F);
+                low = 0x80;
+                high = 0xBF;
+            }
+            i += j;
+            if (j <= extra)
+            {
+                dest[n++] = 0xFFFD;
+            }
+            else if (codePoint >= 0x10000)
+            {
+                codePoint -= 0x10000;
+                dest[n++] = static_cast<wchar_t>(0xD800 | (codePoint >> 10));
+                dest[n++] = static_cast<wchar_t>(0xDC00 | (codePoint & 0x3FF));
+            }
+            else
+            {
+                dest[n++] = static_cast<wchar_t>(codePoint);
+            }
+        }
+
+        dest[n] = L'\0';
+        return n;
+    }
+}
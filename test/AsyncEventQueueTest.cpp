@@ -0,0 +1,184 @@
+// Stress test of AsyncEventQueue: many producer threads against a single consumer,
+// woken up by a fake uv_async_t that coalesces wakeups like the real one.
+
+#include "AsyncEventQueue.h"
+
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+// Record with several fields, so that a torn read shows up as an inconsistent record
+struct Message {
+    int producer;
+    LONG sequence;
+    LONG check;
+};
+
+static LONG Checksum(int producer, LONG sequence) {
+    return producer * 7919 + sequence * 31;
+}
+
+// ************************************************
+// FakeLoop - Stand-in for the uv loop and its async handle
+// ************************************************
+
+// Like uv_async_send, Send can be called from any thread, and several calls before the loop wakes up
+// result in a single call of the handler
+class FakeLoop {
+
+    public:
+
+        FakeLoop() : _pending(false), _stopped(false), _wakeups(0) {}
+
+        void Send() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _pending = true;
+            _condition.notify_one();
+        }
+
+        void Stop() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+            _condition.notify_one();
+        }
+
+        template<typename Handler>
+        void Run(Handler handler) {
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    while (!_pending && !_stopped)
+                        _condition.wait(lock);
+                    if (!_pending)
+                        return;
+                    _pending = false;
+                }
+                _wakeups++;
+                handler();
+            }
+        }
+
+        long GetWakeups() const { return _wakeups; }
+
+    private:
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _pending;
+        bool _stopped;
+        long _wakeups;
+};
+
+// Fills and empties a queue on a single thread, across several laps of the ring
+static void TestSingleThread() {
+    static AsyncEventQueue<Message, 8> queue;
+    Message message = { 0, 0, 0 };
+    CHECK(!queue.Pop(message));
+    CHECK(queue.GetSize() == 0);
+
+    for (int lap = 0; lap < 5; lap++) {
+        for (LONG i = 0; i < 8; i++) {
+            Message pushed = { lap, i, Checksum(lap, i) };
+            CHECK(queue.Push(pushed));
+        }
+        Message extra = { lap, 8, 0 };
+        CHECK(!queue.Push(extra));
+        CHECK(queue.GetSize() == 8);
+
+        for (LONG i = 0; i < 8; i++) {
+            CHECK(queue.Pop(message));
+            CHECK(message.producer == lap && message.sequence == i && message.check == Checksum(lap, i));
+        }
+        CHECK(!queue.Pop(message));
+        CHECK(queue.GetSize() == 0);
+    }
+}
+
+// Producers raise their messages as fast as they can, retrying when the queue is full.
+// The consumer drains at most a full queue per wakeup, like JSTaskDialog::AsyncMessageHandler,
+// and checks that the messages of each producer arrive exactly once and in order.
+static void TestManyProducers(int producers, LONG messagesPerProducer) {
+    static const LONG Capacity = 1024;
+    static AsyncEventQueue<Message, Capacity> queue;
+    FakeLoop loop;
+
+    std::vector<LONG> expected(producers, 0);
+    long received = 0;
+    long total = (long)producers * messagesPerProducer;
+    long fullQueue = 0;
+    std::mutex fullQueueMutex;
+
+    std::thread consumer([&]() {
+        loop.Run([&]() {
+            Message message;
+            LONG processed;
+            for (processed = 0; processed < Capacity && queue.Pop(message); processed++) {
+                CHECK(message.producer >= 0 && message.producer < producers);
+                CHECK(message.check == Checksum(message.producer, message.sequence));
+                CHECK(message.sequence == expected[message.producer]);
+                expected[message.producer] = message.sequence + 1;
+                received++;
+            }
+            if (processed == Capacity)
+                loop.Send();
+            if (received == total)
+                loop.Stop();
+        });
+    });
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.push_back(std::thread([&, p]() {
+            long full = 0;
+            for (LONG i = 0; i < messagesPerProducer; i++) {
+                Message message = { p, i, Checksum(p, i) };
+                while (!queue.Push(message)) {
+                    full++;
+                    std::this_thread::yield();
+                }
+                loop.Send();
+            }
+            std::lock_guard<std::mutex> lock(fullQueueMutex);
+            fullQueue += full;
+        }));
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    consumer.join();
+
+    CHECK(received == total);
+    for (int p = 0; p < producers; p++)
+        CHECK(expected[p] == messagesPerProducer);
+    CHECK(queue.GetSize() == 0);
+
+    printf("%d producers x %ld messages: %ld wakeups, %ld pushes on a full queue\n",
+           producers, (long)messagesPerProducer, loop.GetWakeups(), fullQueue);
+}
+
+int main() {
+    TestSingleThread();
+    TestManyProducers(1, 200000);
+    TestManyProducers(4, 200000);
+    TestManyProducers(16, 50000);
+    TestManyProducers(64, 10000);
+
+    if (failures) {
+        fprintf(stderr, "AsyncEventQueue: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("AsyncEventQueue: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+// Tests of DialogWorkerPool: requests queued in a row never wait for the same idle thread,
+// and work queued while modal dialogs are open runs right away, on a thread of its own.
+// The point of the pool is to keep the modal dialogs off libuv's threadpool, so that fs, dns and crypto
+// work is never stuck behind them. The test executables do not link libuv, so they check the pool side:
+// each open dialog holds a thread of the pool, and other work never waits for a dialog to be closed.
+
+#include "DialogWorkerPool.h"
+#include "HeadlessBackend.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+static volatile LONG completed = 0;
+
+static void Complete(DialogWork* /*request*/) {
+    InterlockedIncrement(&completed);
+}
+
+// Waits up to a second for `value` to reach `expected`
+static bool WaitFor(volatile LONG& value, LONG expected) {
+    for (int i = 0; i < 1000 && LoadAcquire(value) < expected; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return LoadAcquire(value) >= expected;
+}
+
+static bool WaitForIdleThreads(DialogWorkerPool& pool, int expected) {
+    for (int i = 0; i < 1000; i++) {
+        int threads, idleThreads, waitingRequests;
+        pool.GetStats(threads, idleThreads, waitingRequests);
+        if (idleThreads == expected)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// ************************************************
+// Tests
+// ************************************************
+
+static volatile LONG started = 0;
+static HANDLE release;
+
+static void RunQuickly(DialogWork* /*request*/) {
+}
+
+static void RunUntilReleased(DialogWork* /*request*/) {
+    InterlockedIncrement(&started);
+    WaitForSingleObject(release, INFINITE);
+}
+
+// Regression test: with a single idle thread, two requests queued in a row both used to wake it up,
+// and the second one waited for the first to be done instead of getting a new thread.
+// Each round queues one more request than there are idle threads, which must all run at once.
+static void TestRequestsInARow(int rounds) {
+    static DialogWorkerPool pool(Complete);
+    completed = 0;
+
+    DialogWork warmUp = DialogWork();
+    warmUp.work = RunQuickly;
+    pool.Queue(&warmUp);
+    CHECK(WaitFor(completed, 1));
+    CHECK(WaitForIdleThreads(pool, 1));
+
+    std::vector<DialogWork> requests(rounds + 1, DialogWork());
+    for (int round = 1; round <= rounds; round++) {
+        completed = 0;
+        started = 0;
+        release = CreateEventW(NULL, TRUE, FALSE, NULL);
+        for (int i = 0; i <= round; i++) {
+            requests[i].work = RunUntilReleased;
+            pool.Queue(&requests[i]);
+        }
+        CHECK(WaitFor(started, round + 1));
+
+        int threads, idleThreads, waitingRequests;
+        pool.GetStats(threads, idleThreads, waitingRequests);
+        CHECK(threads == round + 1);
+        CHECK(idleThreads == 0);
+        CHECK(waitingRequests == 0);
+
+        SetEvent(release);
+        CHECK(WaitFor(completed, round + 1));
+        CHECK(WaitForIdleThreads(pool, round + 1));
+        CloseHandle(release);
+        if (failures)
+            break;
+    }
+}
+
+// Headless dialogs shown by the pool, which stay open until they are canceled
+struct OpenDialogs {
+    HeadlessBackend backend;
+    std::vector<TASKDIALOGCONFIG> configs;
+    std::vector<DialogWork> requests;
+    std::vector<HWND> handles;
+    volatile LONG created;
+};
+
+static HRESULT CALLBACK DialogCallback(HWND handle, UINT notification, WPARAM /*wParam*/, LPARAM /*lParam*/, LONG_PTR data) {
+    if (notification != TDN_CREATED)
+        return S_OK;
+    DialogWork* request = reinterpret_cast<DialogWork*>(data);
+    OpenDialogs* dialogs = static_cast<OpenDialogs*>(request->data);
+    dialogs->handles[request - &dialogs->requests[0]] = handle;
+    InterlockedIncrement(&dialogs->created);
+    return S_OK;
+}
+
+static void ShowDialog(DialogWork* request) {
+    OpenDialogs* dialogs = static_cast<OpenDialogs*>(request->data);
+    dialogs->backend.ShowDialog(&dialogs->configs[request - &dialogs->requests[0]], NULL, NULL, NULL);
+}
+
+static void TestOpenDialogs(int count) {
+    static DialogWorkerPool pool(Complete);
+    pool.SetMaxThreads(count + 1);
+    completed = 0;
+
+    OpenDialogs dialogs;
+    dialogs.backend.SetTimerInterval(0);
+    dialogs.created = 0;
+    dialogs.configs.resize(count + 1, TASKDIALOGCONFIG());
+    dialogs.requests.resize(count + 1, DialogWork());
+    dialogs.handles.resize(count + 1, NULL);
+    for (int i = 0; i <= count; i++) {
+        dialogs.configs[i].cbSize = sizeof(TASKDIALOGCONFIG);
+        dialogs.configs[i].pfCallback = DialogCallback;
+        dialogs.configs[i].lpCallbackData = reinterpret_cast<LONG_PTR>(&dialogs.requests[i]);
+        dialogs.requests[i].data = &dialogs;
+        dialogs.requests[i].work = ShowDialog;
+    }
+
+    // All the dialogs are open at once, each on a thread of its own
+    for (int i = 0; i < count; i++)
+        pool.Queue(&dialogs.requests[i]);
+    CHECK(WaitFor(dialogs.created, count));
+
+    // Other work runs right away while they are open
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    DialogWork work = DialogWork();
+    work.work = RunQuickly;
+    pool.Queue(&work);
+    CHECK(WaitFor(completed, 1));
+    long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    CHECK(elapsed < 100);
+
+    int threads, idleThreads, waitingRequests;
+    pool.GetStats(threads, idleThreads, waitingRequests);
+    CHECK(threads == count + 1);
+
+    // Past the limit, a dialog waits for another one to be closed
+    CHECK(WaitForIdleThreads(pool, 1));
+    DialogWork blocker = DialogWork();
+    release = CreateEventW(NULL, TRUE, FALSE, NULL);
+    started = 0;
+    blocker.work = RunUntilReleased;
+    pool.Queue(&blocker);
+    CHECK(WaitFor(started, 1));
+    pool.Queue(&dialogs.requests[count]);
+    pool.GetStats(threads, idleThreads, waitingRequests);
+    CHECK(threads == count + 1);
+    CHECK(waitingRequests == 1);
+    CHECK(dialogs.created == count);
+
+    dialogs.backend.SendDialogMessage(dialogs.handles[0], TDM_CLICK_BUTTON, IDCANCEL);
+    CHECK(WaitFor(dialogs.created, count + 1));
+
+    for (int i = 1; i <= count; i++)
+        dialogs.backend.SendDialogMessage(dialogs.handles[i], TDM_CLICK_BUTTON, IDCANCEL);
+    SetEvent(release);
+    CHECK(WaitFor(completed, count + 3));
+    CHECK(WaitForIdleThreads(pool, count + 1));
+    CloseHandle(release);
+}
+
+int main() {
+    TestRequestsInARow(31);
+    TestOpenDialogs(8);
+    TestOpenDialogs(32);
+
+    if (failures) {
+        fprintf(stderr, "DialogWorkerPool: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("DialogWorkerPool: all checks passed\n");
+    return 0;
+}
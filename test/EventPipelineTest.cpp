@@ -0,0 +1,128 @@
+// Tests of OverflowEventQueue and LatestValueSlot, the event path of JSTaskDialog:
+// events that do not fit in the queue are delivered after it, in order, and only skippable ones are ever lost.
+
+#include "EventPipeline.h"
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+typedef OverflowEventQueue<LONG, 4> SmallQueue;
+
+// ************************************************
+// Tests
+// ************************************************
+
+static void TestOverflow() {
+    SmallQueue queue;
+    for (LONG i = 0; i < 4; i++)
+        CHECK(queue.Push(i, false) == SmallQueue::Queued);
+    CHECK(queue.GetSize() == 4);
+
+    // A full queue sends the events to the overflow list, and a skippable one is skipped behind them
+    CHECK(queue.Push(4, false) == SmallQueue::Queued);
+    CHECK(queue.GetOverflowEvents() == 1);
+    CHECK(queue.Push(-1, true) == SmallQueue::Skipped);
+    CHECK(queue.GetDroppedEvents() == 0);
+
+    // Once room is made, the events still go behind the list
+    std::vector<LONG> delivered;
+    CHECK(queue.Drain([&delivered](LONG& event) { delivered.push_back(event); }) == 4);
+    CHECK(delivered.size() == 4);
+    CHECK(queue.Push(5, false) == SmallQueue::Queued);
+    CHECK(queue.GetOverflowEvents() == 2);
+    CHECK(queue.GetSize() == 0);
+
+    // The list is delivered once the queue is empty
+    CHECK(queue.Drain([&delivered](LONG& event) { delivered.push_back(event); }) == 0);
+    CHECK(delivered.size() == 6);
+    for (size_t i = 0; i < delivered.size(); i++)
+        CHECK(delivered[i] == (LONG)i);
+
+    // Without the list, events go to the queue again, and a skippable event finding it full is dropped
+    for (LONG i = 0; i < 4; i++)
+        CHECK(queue.Push(i, true) == SmallQueue::Queued);
+    CHECK(queue.Push(4, true) == SmallQueue::Dropped);
+    CHECK(queue.GetDroppedEvents() == 1);
+    CHECK(queue.GetOverflowEvents() == 2);
+}
+
+// Events pushed while draining are delivered by the next round
+static void TestPushWhileDraining() {
+    SmallQueue queue;
+    queue.Push(0, false);
+    LONG delivered = 0;
+    auto deliver = [&](LONG& event) {
+        delivered++;
+        if (event < 9)
+            queue.Push(event + 1, false);
+    };
+    CHECK(queue.Drain(deliver) == 4);
+    CHECK(delivered == 4);
+    while (queue.Drain(deliver))
+        ;
+    CHECK(delivered == 10);
+}
+
+// Many dialog threads against the main thread: no event is lost or reordered for a given thread
+static void TestProducers(int producers, LONG events) {
+    static OverflowEventQueue<LONG, 64> queue;
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < producers; producer++) {
+        threads.push_back(std::thread([producer, events]() {
+            for (LONG i = 0; i < events; i++)
+                queue.Push(producer * events + i, false);
+        }));
+    }
+
+    std::vector<LONG> next(producers, 0);
+    LONG delivered = 0;
+    while (delivered < producers * events) {
+        queue.Drain([&](LONG& event) {
+            int producer = event / events;
+            CHECK(event % events == next[producer]);
+            next[producer]++;
+            delivered++;
+        });
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    CHECK(queue.GetDroppedEvents() == 0);
+    CHECK(queue.GetSize() == 0);
+}
+
+static void TestLatestValueSlot() {
+    LatestValueSlot slot;
+    CHECK(slot.Set(10));
+    CHECK(!slot.Set(20));
+    CHECK(!slot.Set(30));
+    CHECK(slot.Take() == 30);
+    CHECK(slot.Set(40));
+    slot.Clear();
+    CHECK(slot.Set(50));
+    CHECK(slot.Take() == 50);
+}
+
+int main() {
+    TestOverflow();
+    TestPushWhileDraining();
+    TestProducers(8, 20000);
+    TestLatestValueSlot();
+
+    if (failures) {
+        fprintf(stderr, "EventPipeline: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("EventPipeline: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,347 @@
+// Tests of HeadlessBackend: the schedule of the notifications, the TDM_* messages sent and posted from other
+// threads, the hooks and timers used by Kerr::TaskDialog, navigation, nested dialogs, and dialogs closing
+// while other threads keep sending them messages.
+
+#include "HeadlessBackend.h"
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+// What a dialog went through, filled by its callback
+struct Record {
+    HeadlessBackend* backend;
+    HWND volatile handle;
+    std::vector<UINT> notifications;
+    volatile LONG timers;
+    volatile LONG clicks;
+    LONG keepOpenClicks;
+    HeadlessBackend::Model model;
+};
+
+static HRESULT CALLBACK RecordCallback(HWND handle, UINT notification, WPARAM /*wParam*/, LPARAM /*lParam*/, LONG_PTR data) {
+    Record* record = reinterpret_cast<Record*>(data);
+    record->notifications.push_back(notification);
+    switch (notification) {
+        case TDN_CREATED:
+            StoreRelease(record->handle, handle);
+            break;
+        case TDN_TIMER:
+            record->timers++;
+            break;
+        case TDN_BUTTON_CLICKED:
+            if (InterlockedIncrement(&record->clicks) <= record->keepOpenClicks)
+                return S_FALSE;
+            break;
+        case TDN_DESTROYED:
+            record->model = *record->backend->GetModel(handle);
+            break;
+    }
+    return S_OK;
+}
+
+static void InitializeRecord(Record& record, HeadlessBackend& backend) {
+    record.backend = &backend;
+    record.handle = NULL;
+    record.timers = 0;
+    record.clicks = 0;
+    record.keepOpenClicks = 0;
+}
+
+static TASKDIALOGCONFIG MakeConfig(Record& record, PCWSTR mainInstruction, int flags) {
+    TASKDIALOGCONFIG config = TASKDIALOGCONFIG();
+    config.cbSize = sizeof(TASKDIALOGCONFIG);
+    config.dwFlags = flags;
+    config.pszWindowTitle = L"Title";
+    config.pszMainInstruction = mainInstruction;
+    config.pszContent = L"Content";
+    config.pfCallback = RecordCallback;
+    config.lpCallbackData = reinterpret_cast<LONG_PTR>(&record);
+    return config;
+}
+
+static HWND WaitForHandle(Record& record) {
+    while (!LoadAcquire(record.handle))
+        std::this_thread::yield();
+    return record.handle;
+}
+
+// ************************************************
+// Tests
+// ************************************************
+
+static void TestSchedule() {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(2);
+    backend.SetCloseAfter(60);
+
+    Record record;
+    InitializeRecord(record, backend);
+    TASKDIALOGCONFIG config = MakeConfig(record, L"Schedule", TDF_CALLBACK_TIMER);
+    int button = 0;
+    DWORD start = GetTickCount();
+    CHECK(backend.ShowDialog(&config, &button, NULL, NULL) == S_OK);
+
+    CHECK(GetTickCount() - start >= 60);
+    CHECK(button == IDCANCEL);
+    CHECK(record.timers >= 5);
+    CHECK(record.clicks == 1);
+    CHECK(record.notifications.size() >= 4);
+    CHECK(record.notifications[0] == TDN_DIALOG_CONSTRUCTED);
+    CHECK(record.notifications[1] == TDN_CREATED);
+    CHECK(record.notifications[record.notifications.size() - 2] == TDN_BUTTON_CLICKED);
+    CHECK(record.notifications.back() == TDN_DESTROYED);
+    CHECK(record.model.windowTitle == L"Title");
+    CHECK(record.model.texts[TDE_MAIN_INSTRUCTION] == L"Schedule");
+}
+
+// The callback keeps the dialog open for the first clicks
+static void TestClicks() {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(0);
+    backend.SetClickInterval(2);
+    backend.SetClickButton(1);
+
+    Record record;
+    InitializeRecord(record, backend);
+    record.keepOpenClicks = 3;
+    TASKDIALOG_BUTTON buttons[] = { { 100, L"First" }, { 101, L"Second" } };
+    TASKDIALOG_BUTTON radioButtons[] = { { 10, L"Radio" }, { 11, L"Other radio" } };
+    TASKDIALOGCONFIG config = MakeConfig(record, L"Clicks", TDF_CALLBACK_TIMER | TDF_VERIFICATION_FLAG_CHECKED);
+    config.cButtons = 2;
+    config.pButtons = buttons;
+    config.cRadioButtons = 2;
+    config.pRadioButtons = radioButtons;
+    int button = 0, radioButton = 0;
+    BOOL verificationChecked = FALSE;
+    backend.ShowDialog(&config, &button, &radioButton, &verificationChecked);
+
+    CHECK(button == 101);
+    CHECK(record.clicks == 4);
+    CHECK(record.timers == 0);
+    CHECK(radioButton == 10);
+    CHECK(verificationChecked == TRUE);
+}
+
+static bool CountingHook(HWND handle, UINT message, WPARAM wParam, LPARAM /*lParam*/, DWORD_PTR data, LRESULT* result) {
+    Record* record = reinterpret_cast<Record*>(data);
+    if (message == WM_USER + 1) {
+        *result = 7;
+        return true;
+    }
+    if (message == WM_TIMER && wParam == 42) {
+        if (++record->timers == 5) {
+            record->backend->KillDialogTimer(handle, 42);
+            record->backend->SendDialogMessage(handle, TDM_CLICK_BUTTON, IDOK);
+        }
+        *result = 0;
+        return true;
+    }
+    return false;
+}
+
+static HRESULT CALLBACK HookingCallback(HWND handle, UINT notification, WPARAM wParam, LPARAM lParam, LONG_PTR data) {
+    Record* record = reinterpret_cast<Record*>(data);
+    if (notification == TDN_DIALOG_CONSTRUCTED) {
+        CHECK(record->backend->SetDialogHook(handle, CountingHook, data));
+        record->backend->SetDialogTimer(handle, 42, 1);
+    } else if (notification == TDN_DESTROYED) {
+        record->backend->RemoveDialogHook(handle, CountingHook);
+    }
+    return RecordCallback(handle, notification, wParam, lParam, data);
+}
+
+// Messages sent and posted from another thread, in order, through the hooks, then to the model
+static void TestMessages() {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(0);
+
+    Record record;
+    InitializeRecord(record, backend);
+    TASKDIALOGCONFIG config = MakeConfig(record, L"Messages", 0);
+    config.pfCallback = HookingCallback;
+
+    // The hook kills its timer and clicks OK after 5 ticks: the callback keeps the dialog open
+    record.keepOpenClicks = 1;
+    int button = 0, radioButton = 0;
+    std::thread dialogThread([&]() {
+        backend.ShowDialog(&config, &button, &radioButton, NULL);
+    });
+
+    HWND handle = WaitForHandle(record);
+    CHECK(backend.SendDialogMessage(handle, WM_USER + 1) == 7);
+    CHECK(backend.SendDialogMessage(handle, TDM_SET_PROGRESS_BAR_POS, 40) == 0);
+    CHECK(backend.SendDialogMessage(handle, TDM_SET_PROGRESS_BAR_POS, 60) == 40);
+    CHECK(backend.PostDialogMessage(handle, TDM_SET_PROGRESS_BAR_STATE, PBST_PAUSED));
+    CHECK(backend.PostDialogMessage(handle, TDM_SET_ELEMENT_TEXT, TDE_FOOTER, reinterpret_cast<LPARAM>(L"Footer")));
+    CHECK(backend.PostDialogMessage(handle, WM_SETTEXT, 0, reinterpret_cast<LPARAM>(L"New title")));
+    CHECK(backend.PostDialogMessage(handle, TDM_CLICK_RADIO_BUTTON, 11));
+    while (LoadAcquire(record.clicks) < 1)
+        std::this_thread::yield();
+    CHECK(backend.PostDialogMessage(handle, TDM_CLICK_BUTTON, 100));
+    dialogThread.join();
+
+    CHECK(button == 100);
+    CHECK(radioButton == 11);
+    CHECK(record.timers == 5);
+    CHECK(record.clicks == 2);
+    CHECK(record.model.progressPosition == 60);
+    CHECK(record.model.progressState == PBST_PAUSED);
+    CHECK(record.model.texts[TDE_FOOTER] == L"Footer");
+    CHECK(record.model.texts[TDE_CONTENT] == L"Content");
+    CHECK(record.model.windowTitle == L"New title");
+
+    // The dialog is gone
+    CHECK(backend.SendDialogMessage(handle, TDM_SET_PROGRESS_BAR_POS, 10) == 0);
+    CHECK(!backend.PostDialogMessage(handle, TDM_CLICK_BUTTON, IDOK));
+}
+
+// Navigates on the first tick, and closes on the first tick of the new page
+static HRESULT CALLBACK NavigatingCallback(HWND handle, UINT notification, WPARAM wParam, LPARAM lParam, LONG_PTR data) {
+    Record* record = reinterpret_cast<Record*>(data);
+    static TASKDIALOGCONFIG secondPage;
+    if (notification == TDN_TIMER && record->timers == 0) {
+        secondPage = MakeConfig(*record, L"Second page", TDF_CALLBACK_TIMER);
+        secondPage.pfCallback = NavigatingCallback;
+        record->backend->SendDialogMessage(handle, TDM_NAVIGATE_PAGE, 0, reinterpret_cast<LPARAM>(&secondPage));
+        CHECK(record->backend->GetModel(handle)->texts[TDE_MAIN_INSTRUCTION] == L"Second page");
+    } else if (notification == TDN_TIMER) {
+        record->backend->SendDialogMessage(handle, TDM_CLICK_BUTTON, IDOK);
+    }
+    return RecordCallback(handle, notification, wParam, lParam, data);
+}
+
+static void TestNavigation() {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(1);
+
+    Record record;
+    InitializeRecord(record, backend);
+    TASKDIALOGCONFIG config = MakeConfig(record, L"First page", TDF_CALLBACK_TIMER);
+    config.pfCallback = NavigatingCallback;
+    int button = 0;
+    backend.ShowDialog(&config, &button, NULL, NULL);
+
+    CHECK(button == IDOK);
+    CHECK(record.timers == 2);
+    CHECK(record.model.texts[TDE_MAIN_INSTRUCTION] == L"Second page");
+    size_t constructed = 0, navigated = 0;
+    for (size_t i = 0; i < record.notifications.size(); i++) {
+        constructed += record.notifications[i] == TDN_DIALOG_CONSTRUCTED;
+        navigated += record.notifications[i] == TDN_NAVIGATED;
+    }
+    CHECK(constructed == 2);
+    CHECK(navigated == 1);
+}
+
+// A dialog shown from the callback of another one: the outer dialog keeps ticking until it closes the inner one
+struct Nested {
+    Record outer;
+    Record inner;
+    int outerTimersBeforeInner;
+};
+
+static HRESULT CALLBACK OuterCallback(HWND handle, UINT notification, WPARAM wParam, LPARAM lParam, LONG_PTR data) {
+    Nested* nested = reinterpret_cast<Nested*>(data);
+    HRESULT result = RecordCallback(handle, notification, wParam, lParam, reinterpret_cast<LONG_PTR>(&nested->outer));
+    if (notification != TDN_TIMER)
+        return result;
+
+    if (nested->outer.timers == 3) {
+        nested->outerTimersBeforeInner = nested->outer.timers;
+        TASKDIALOGCONFIG config = MakeConfig(nested->inner, L"Inner", 0);
+        int button = 0;
+        nested->outer.backend->ShowDialog(&config, &button, NULL, NULL);
+        CHECK(button == IDOK);
+        nested->outer.backend->SendDialogMessage(handle, TDM_CLICK_BUTTON, IDOK);
+    } else if (nested->outer.timers == nested->outerTimersBeforeInner + 5) {
+        nested->outer.backend->SendDialogMessage(nested->inner.handle, TDM_CLICK_BUTTON, IDOK);
+    }
+    return result;
+}
+
+static void TestNested() {
+    HeadlessBackend backend;
+    backend.SetTimerInterval(1);
+
+    Nested nested;
+    InitializeRecord(nested.outer, backend);
+    InitializeRecord(nested.inner, backend);
+    nested.outerTimersBeforeInner = -1;
+    TASKDIALOGCONFIG config = MakeConfig(nested.outer, L"Outer", TDF_CALLBACK_TIMER);
+    config.pfCallback = OuterCallback;
+    config.lpCallbackData = reinterpret_cast<LONG_PTR>(&nested);
+    int button = 0;
+    backend.ShowDialog(&config, &button, NULL, NULL);
+
+    CHECK(button == IDOK);
+    CHECK(nested.outer.timers == 8);
+    CHECK(nested.inner.timers == 0);
+    CHECK(nested.inner.notifications.back() == TDN_DESTROYED);
+}
+
+// Dialogs closing on their own while the main thread keeps sending and posting them messages
+static void TestConcurrentDialogs() {
+    static const int Dialogs = 8;
+    HeadlessBackend backend;
+    backend.SetTimerInterval(1);
+    backend.SetCloseAfter(100);
+
+    Record records[Dialogs];
+    TASKDIALOGCONFIG configs[Dialogs];
+    volatile LONG closed = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < Dialogs; i++) {
+        InitializeRecord(records[i], backend);
+        configs[i] = MakeConfig(records[i], L"Concurrent", TDF_CALLBACK_TIMER);
+        threads.push_back(std::thread([&, i]() {
+            backend.ShowDialog(&configs[i], NULL, NULL, NULL);
+            InterlockedIncrement(&closed);
+        }));
+    }
+
+    long messages = 0;
+    for (int i = 0; i < Dialogs; i++)
+        WaitForHandle(records[i]);
+    while (LoadAcquire(closed) < Dialogs) {
+        for (int i = 0; i < Dialogs; i++) {
+            backend.SendDialogMessage(records[i].handle, TDM_SET_PROGRESS_BAR_POS, messages % 100);
+            backend.PostDialogMessage(records[i].handle, TDM_SET_PROGRESS_BAR_STATE, PBST_NORMAL);
+            messages++;
+        }
+    }
+    for (int i = 0; i < Dialogs; i++)
+        threads[i].join();
+
+    for (int i = 0; i < Dialogs; i++) {
+        CHECK(records[i].timers > 0);
+        CHECK(records[i].notifications.back() == TDN_DESTROYED);
+    }
+    CHECK(messages > 0);
+}
+
+int main() {
+    TestSchedule();
+    TestClicks();
+    TestMessages();
+    TestNavigation();
+    TestNested();
+    TestConcurrentDialogs();
+
+    if (failures) {
+        fprintf(stderr, "HeadlessBackend: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("HeadlessBackend: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Tests of LatencyHistogram: the buckets cover every duration without gaps, and the percentiles
+// stay within 1/SubBuckets of the exact ones, from a few microseconds to the clamped durations.
+
+#include "LatencyHistogram.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+// Index of the only non-empty bucket of the histogram, or -1
+static int GetOnlyBucket(const LatencyHistogram& histogram) {
+    int found = -1;
+    for (int i = 0; i < LatencyHistogram::BucketsCount; i++) {
+        if (!histogram.GetBucket(i))
+            continue;
+        if (found != -1)
+            return -1;
+        found = i;
+    }
+    return found;
+}
+
+static void TestBuckets() {
+    // The lower bounds grow, and each bucket is at most 1/SubBuckets of its lower bound wide
+    CHECK(LatencyHistogram::GetBucketLowerBound(0) == 0);
+    for (int i = 1; i < LatencyHistogram::BucketsCount; i++) {
+        uint64_t lower = LatencyHistogram::GetBucketLowerBound(i);
+        uint64_t width = lower - LatencyHistogram::GetBucketLowerBound(i - 1);
+        CHECK(width >= 1);
+        CHECK(i < 2 * LatencyHistogram::SubBuckets ? width == 1 : width * LatencyHistogram::SubBuckets <= lower);
+    }
+    CHECK(LatencyHistogram::GetBucketLowerBound(LatencyHistogram::BucketsCount - 1) == 0xF8000000ULL);
+
+    // Every duration goes to the bucket whose bounds hold it
+    static const uint64_t microseconds[] = { 0, 1, 15, 16, 31, 32, 33, 34, 63, 64, 100, 999, 1000, 1023, 1024,
+                                             65535, 65536, 1000000, 0xFFFFFFFEULL };
+    for (size_t j = 0; j < sizeof(microseconds) / sizeof(microseconds[0]); j++) {
+        LatencyHistogram histogram;
+        histogram.Record(microseconds[j] * 1000 + 999);
+        int i = GetOnlyBucket(histogram);
+        CHECK(i >= 0);
+        CHECK(LatencyHistogram::GetBucketLowerBound(i) <= microseconds[j]);
+        CHECK(i == LatencyHistogram::BucketsCount - 1 || microseconds[j] < LatencyHistogram::GetBucketLowerBound(i + 1));
+        CHECK(histogram.GetPercentile(50) == microseconds[j]);
+        CHECK(histogram.GetMax() == microseconds[j]);
+    }
+
+    // Longer durations are counted in the last bucket, but keep their maximum and mean
+    LatencyHistogram histogram;
+    histogram.Record(10000000000000ULL);
+    CHECK(GetOnlyBucket(histogram) == LatencyHistogram::BucketsCount - 1);
+    CHECK(histogram.GetMax() == 10000000000ULL);
+    CHECK(histogram.GetMean() == 10000000000ULL);
+    CHECK(histogram.GetPercentile(99) == 10000000000ULL);
+}
+
+static void TestPercentiles() {
+    LatencyHistogram empty;
+    CHECK(empty.GetCount() == 0 && empty.GetMean() == 0 && empty.GetPercentile(99) == 0);
+
+    // Durations from 1 microsecond to 100 seconds, spread over the powers of ten
+    LatencyHistogram histogram;
+    std::vector<uint64_t> durations;
+    uint64_t seed = 12345;
+    for (int i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t magnitude = 1;
+        for (int digits = (int)((seed >> 33) % 8); digits > 0; digits--)
+            magnitude *= 10;
+        uint64_t microseconds = magnitude + (seed >> 40) % (9 * magnitude);
+        durations.push_back(microseconds);
+        histogram.Record(microseconds * 1000);
+    }
+    std::sort(durations.begin(), durations.end());
+    CHECK(histogram.GetCount() == durations.size());
+    CHECK(histogram.GetMax() == durations.back());
+
+    static const double percentiles[] = { 1, 10, 25, 50, 75, 90, 99, 99.9 };
+    for (size_t j = 0; j < sizeof(percentiles) / sizeof(percentiles[0]); j++) {
+        uint64_t exact = durations[(size_t)(durations.size() * percentiles[j] / 100)];
+        uint64_t estimate = histogram.GetPercentile(percentiles[j]);
+        CHECK(estimate >= exact);
+        CHECK((estimate - exact) * LatencyHistogram::SubBuckets <= exact);
+        printf("P%g: %llu for %llu\n", percentiles[j], (unsigned long long)estimate, (unsigned long long)exact);
+    }
+}
+
+int main() {
+    TestBuckets();
+    TestPercentiles();
+
+    if (failures) {
+        fprintf(stderr, "LatencyHistogram: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("LatencyHistogram: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Tests of StringArena, and regression test of its memory use: a dialog whose strings are replaced
+// over and over, like one shown again and again with new texts, must not grow without bounds.
+
+#include "StringArena.h"
+
+#include <stdio.h>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+// Fills a new string of the arena with `length` times the letter `c`
+static PCWSTR MakeString(StringArena& arena, size_t length, wchar_t c) {
+    PWSTR str = arena.Allocate(length);
+    wmemset(str, c, length);
+    str[length] = L'\0';
+    return str;
+}
+
+static bool IsString(PCWSTR str, size_t length, wchar_t c) {
+    for (size_t i = 0; i < length; i++)
+        if (str[i] != c)
+            return false;
+    return str[length] == L'\0';
+}
+
+static void TestAllocate() {
+    StringArena arena;
+    CHECK(arena.GetUsed() == 0);
+    CHECK(!arena.Owns(L"outside"));
+
+    PCWSTR a = MakeString(arena, 10, L'a');
+    PCWSTR b = MakeString(arena, 0, L'b');
+    PCWSTR c = arena.Copy(L"copy");
+    CHECK(arena.Owns(a) && arena.Owns(b) && arena.Owns(c));
+    CHECK(arena.GetUsed() == 11 + 1 + 5);
+    CHECK(IsString(a, 10, L'a'));
+    CHECK(wcscmp(c, L"copy") == 0);
+
+    // A string larger than a chunk gets a chunk of its own, and the current chunk keeps being filled
+    PCWSTR large = MakeString(arena, 10000, L'l');
+    PCWSTR d = MakeString(arena, 5, L'd');
+    CHECK(arena.Owns(large) && arena.Owns(d));
+    CHECK(d == c + 5);
+    CHECK(IsString(large, 10000, L'l') && IsString(a, 10, L'a'));
+
+    // Filling chunks
+    std::vector<PCWSTR> strings;
+    for (int i = 0; i < 1000; i++)
+        strings.push_back(MakeString(arena, i % 50, (wchar_t)(L'A' + i % 26)));
+    for (int i = 0; i < 1000; i++)
+        CHECK(arena.Owns(strings[i]) && IsString(strings[i], i % 50, (wchar_t)(L'A' + i % 26)));
+
+    StringArena other;
+    other.Swap(arena);
+    CHECK(arena.GetUsed() == 0 && !arena.Owns(a));
+    CHECK(other.Owns(a) && other.Owns(large));
+}
+
+static void TestCompact() {
+    StringArena arena;
+    PCWSTR fields[3];
+    PCWSTR* pointers[3] = { &fields[0], &fields[1], &fields[2] };
+
+    // Nothing to gain on a small arena
+    fields[0] = arena.Copy(L"title");
+    fields[1] = arena.Copy(L"content");
+    fields[2] = arena.Copy(L"footer");
+    PCWSTR title = fields[0];
+    CHECK(!arena.Compact(pointers, 3));
+    CHECK(fields[0] == title);
+
+    // Replaced strings pile up, and are dropped once they are most of the arena
+    for (int i = 0; i < 100; i++)
+        fields[1] = MakeString(arena, 100, (wchar_t)(L'a' + i % 26));
+    CHECK(arena.MayNeedCompacting());
+    CHECK(arena.Compact(pointers, 3));
+    CHECK(arena.GetUsed() == 6 + 101 + 7);
+    CHECK(arena.Owns(fields[0]) && arena.Owns(fields[1]) && arena.Owns(fields[2]));
+    CHECK(!arena.Owns(title));
+    CHECK(wcscmp(fields[0], L"title") == 0 && IsString(fields[1], 100, L'a' + 99 % 26) && wcscmp(fields[2], L"footer") == 0);
+
+    // Right after compacting, there is nothing to do until the arena grows again
+    CHECK(!arena.MayNeedCompacting());
+    CHECK(!arena.Compact(pointers, 3));
+}
+
+// Simulates a dialog shown 100000 times, with new texts and buttons each time, compacted before each show.
+// Also simulates writes on a hidden dialog, compacted after each write.
+static void TestBoundedSize() {
+    static const int Fields = 12;
+    StringArena arena;
+    PCWSTR fields[Fields];
+    PCWSTR* pointers[Fields];
+    for (int f = 0; f < Fields; f++) {
+        fields[f] = arena.Copy(L"");
+        pointers[f] = &fields[f];
+    }
+
+    size_t highWater = 0;
+    size_t peakLive = 0;
+    size_t compactions = 0;
+    for (int show = 0; show < 100000; show++) {
+
+        // New texts of varying size (up to a large ExpandedInformation now and then), and new button captions
+        size_t live = 0;
+        for (int f = 0; f < Fields; f++) {
+            size_t length = (show * 7 + f * 13) % 80;
+            if (f == 0 && show % 1000 == 0)
+                length = 20000;
+            fields[f] = MakeString(arena, length, (wchar_t)(L'a' + (show + f) % 26));
+        }
+        for (int f = 0; f < Fields; f++)
+            live += wcslen(fields[f]) + 1;
+        if (live > peakLive)
+            peakLive = live;
+
+        if (arena.GetUsed() > highWater)
+            highWater = arena.GetUsed();
+        if (arena.Compact(pointers, Fields))
+            compactions++;
+
+        // The arena never holds more than twice the most strings in use at once, plus a chunk
+        CHECK(arena.GetUsed() <= 2 * peakLive + 4096);
+        for (int f = 0; f < Fields; f++)
+            CHECK(arena.Owns(fields[f]));
+    }
+    CHECK(compactions > 0);
+    CHECK(highWater < 100000);
+    printf("100000 shows: %lu compactions, at most %lu characters\n", (unsigned long)compactions, (unsigned long)highWater);
+
+    // A hidden dialog receiving 100000 writes of a 1000 characters text
+    highWater = 0;
+    for (int write = 0; write < 100000; write++) {
+        fields[1] = MakeString(arena, 1000, (wchar_t)(L'a' + write % 26));
+        arena.Compact(pointers, Fields);
+        if (arena.GetUsed() > highWater)
+            highWater = arena.GetUsed();
+    }
+    CHECK(highWater < 30000);
+    CHECK(IsString(fields[1], 1000, L'a' + 99999 % 26));
+    printf("100000 writes: at most %lu characters\n", (unsigned long)highWater);
+}
+
+int main() {
+    TestAllocate();
+    TestCompact();
+    TestBoundedSize();
+
+    if (failures) {
+        fprintf(stderr, "StringArena: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("StringArena: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Tests of CommandQueue and UpdateCombiner, the update path of Kerr::TaskDialog, against headless dialogs:
+// commands are processed in order even when they do not fit in the queue, and every combined update is either
+// applied by a flush or counted as elided.
+
+#include "UpdatePipeline.h"
+#include "HeadlessBackend.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+static const UINT ProcessMessage = WM_USER + 0x100;
+
+// A dialog on its own thread, whose hook processes the commands or flushes the updates like Kerr::TaskDialog
+struct UpdatedDialog {
+    HeadlessBackend backend;
+    TASKDIALOGCONFIG config;
+    std::thread thread;
+    HWND volatile handle;
+    CommandQueue<LONG, 16> commands;
+    UpdateCombiner updates;
+    volatile LONG messages;     // Messages processed by the hook
+    volatile LONG processed;    // Commands processed
+    volatile LONG outOfOrder;
+    volatile LONG flushed;      // Flushes that found the update pending
+};
+
+static bool Hook(HWND /*handle*/, UINT message, WPARAM /*wParam*/, LPARAM /*lParam*/, DWORD_PTR data, LRESULT* result) {
+    UpdatedDialog* dialog = reinterpret_cast<UpdatedDialog*>(data);
+    if (message != ProcessMessage)
+        return false;
+    InterlockedIncrement(&dialog->messages);
+
+    dialog->commands.BeginProcessing();
+    LONG command;
+    while (dialog->commands.Pop(command)) {
+        if (command != dialog->processed)
+            InterlockedIncrement(&dialog->outOfOrder);
+        InterlockedIncrement(&dialog->processed);
+    }
+    if (dialog->updates.BeginFlush() & 1)
+        InterlockedIncrement(&dialog->flushed);
+    *result = TRUE;
+    return true;
+}
+
+static HRESULT CALLBACK Callback(HWND handle, UINT notification, WPARAM /*wParam*/, LPARAM /*lParam*/, LONG_PTR data) {
+    UpdatedDialog* dialog = reinterpret_cast<UpdatedDialog*>(data);
+    if (notification == TDN_DIALOG_CONSTRUCTED)
+        dialog->backend.SetDialogHook(handle, Hook, data);
+    else if (notification == TDN_CREATED)
+        StoreRelease(dialog->handle, handle);
+    else if (notification == TDN_DESTROYED)
+        dialog->backend.RemoveDialogHook(handle, Hook);
+    return S_OK;
+}
+
+static void Show(UpdatedDialog& dialog) {
+    dialog.backend.SetTimerInterval(0);
+    dialog.config = TASKDIALOGCONFIG();
+    dialog.config.cbSize = sizeof(TASKDIALOGCONFIG);
+    dialog.config.pfCallback = Callback;
+    dialog.config.lpCallbackData = reinterpret_cast<LONG_PTR>(&dialog);
+    dialog.handle = NULL;
+    dialog.messages = 0;
+    dialog.processed = 0;
+    dialog.outOfOrder = 0;
+    dialog.flushed = 0;
+    dialog.thread = std::thread([&dialog]() {
+        dialog.backend.ShowDialog(&dialog.config, NULL, NULL, NULL);
+    });
+    while (!LoadAcquire(dialog.handle))
+        std::this_thread::yield();
+}
+
+static void Close(UpdatedDialog& dialog) {
+    dialog.backend.SendDialogMessage(dialog.handle, TDM_CLICK_BUTTON, IDOK);
+    dialog.thread.join();
+}
+
+// Waits up to a second for `value` to reach `expected`
+static bool WaitFor(volatile LONG& value, LONG expected) {
+    for (int i = 0; i < 1000 && LoadAcquire(value) < expected; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return LoadAcquire(value) >= expected;
+}
+
+// ************************************************
+// Tests
+// ************************************************
+
+// Many more commands than the queue holds: they are all processed in order, with fewer messages than commands,
+// and none is queued once the dialog is closed
+static void TestCommands(LONG count) {
+    UpdatedDialog dialog;
+    Show(dialog);
+    for (LONG i = 0; i < count; i++)
+        CHECK(dialog.commands.Push(&dialog.backend, dialog.handle, ProcessMessage, i));
+    CHECK(WaitFor(dialog.processed, count));
+    CHECK(dialog.processed == count);
+    CHECK(dialog.outOfOrder == 0);
+    CHECK(dialog.messages < count);
+
+    HWND handle = dialog.handle;
+    Close(dialog);
+    for (LONG i = 0; i < 16; i++)
+        dialog.commands.Push(&dialog.backend, handle, ProcessMessage, i);
+    CHECK(!dialog.commands.Push(&dialog.backend, handle, ProcessMessage, 16));
+}
+
+// Every update is either flushed or elided by a newer one
+static void TestCombinedUpdates(LONG count) {
+    UpdatedDialog dialog;
+    Show(dialog);
+    for (LONG i = 0; i < count; i++) {
+        dialog.updates.Combine(1);
+        dialog.updates.RequestFlush(&dialog.backend, dialog.handle, ProcessMessage);
+    }
+    LONG elided = dialog.updates.GetElidedUpdates();
+    CHECK(WaitFor(dialog.flushed, count - elided));
+    CHECK(dialog.flushed + elided == count);
+    CHECK(dialog.messages <= count);
+    Close(dialog);
+}
+
+static void TestCombiner() {
+    UpdateCombiner updates;
+    updates.Combine(1);
+    updates.Combine(2);
+    CHECK(updates.GetElidedUpdates() == 0);
+    updates.Combine(1);
+    CHECK(updates.GetElidedUpdates() == 1);
+    updates.CountElided();
+    CHECK(updates.GetElidedUpdates() == 2);
+    CHECK(updates.BeginFlush() == 3);
+    CHECK(updates.BeginFlush() == 0);
+
+    // Values applied again are not elided
+    updates.Reapply(4);
+    updates.Reapply(4);
+    CHECK(updates.GetElidedUpdates() == 2);
+    updates.Discard();
+    CHECK(updates.BeginFlush() == 0);
+}
+
+int main() {
+    TestCombiner();
+    TestCommands(100000);
+    TestCombinedUpdates(100000);
+
+    if (failures) {
+        fprintf(stderr, "UpdatePipeline: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("UpdatePipeline: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+// Tests of Utf8::ToUtf16: valid input against an independent encoder, invalid input against the
+// Unicode recommendation for replacement characters, and runs of ASCII around the 16-byte chunks of
+// the SSE2 path. The Utf8ScalarTest target builds the same tests with UTF8_NO_SSE2.
+
+#include "Utf8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            failures++; \
+        } \
+    } while (0)
+
+static int failures = 0;
+
+typedef std::vector<unsigned int> Units;
+
+// Decodes `bytes`, checking the terminator and that nothing is written past it
+static Units Decode(const std::string& bytes) {
+    std::vector<wchar_t> buffer(bytes.size() + 8, (wchar_t)0x5A5A);
+    size_t written = Utf8::ToUtf16(&buffer[0], bytes.data(), bytes.size());
+    CHECK(written <= bytes.size());
+    CHECK(buffer[written] == 0);
+    for (size_t i = bytes.size() + 1; i < buffer.size(); i++)
+        CHECK(buffer[i] == (wchar_t)0x5A5A);
+    return Units(buffer.begin(), buffer.begin() + written);
+}
+
+static void CheckDecode(const char* name, const std::string& bytes, const Units& expected) {
+    Units units = Decode(bytes);
+    if (units != expected) {
+        fprintf(stderr, "%s: got", name);
+        for (size_t i = 0; i < units.size(); i++)
+            fprintf(stderr, " %04X", units[i]);
+        fprintf(stderr, ", expected");
+        for (size_t i = 0; i < expected.size(); i++)
+            fprintf(stderr, " %04X", expected[i]);
+        fprintf(stderr, "\n");
+        failures++;
+    }
+}
+
+// ************************************************
+// Reference encoder
+// ************************************************
+
+static void AppendUtf8(std::string& bytes, unsigned int codePoint) {
+    if (codePoint < 0x80) {
+        bytes += (char)codePoint;
+    } else if (codePoint < 0x800) {
+        bytes += (char)(0xC0 | (codePoint >> 6));
+        bytes += (char)(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        bytes += (char)(0xE0 | (codePoint >> 12));
+        bytes += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        bytes += (char)(0x80 | (codePoint & 0x3F));
+    } else {
+        bytes += (char)(0xF0 | (codePoint >> 18));
+        bytes += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        bytes += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        bytes += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+static void AppendUtf16(Units& units, unsigned int codePoint) {
+    if (codePoint < 0x10000) {
+        units.push_back(codePoint);
+    } else {
+        units.push_back(0xD800 | ((codePoint - 0x10000) >> 10));
+        units.push_back(0xDC00 | ((codePoint - 0x10000) & 0x3FF));
+    }
+}
+
+// Random scalar value, mostly ASCII so that the chunks of the fast path are exercised
+static unsigned int RandomCodePoint() {
+    switch (rand() % 8) {
+        case 0: return 0x80 + rand() % (0x800 - 0x80);
+        case 1: {
+            unsigned int codePoint = 0x800 + rand() % (0x10000 - 0x800);
+            return codePoint >= 0xD800 && codePoint <= 0xDFFF ? 0xE000 : codePoint;
+        }
+        case 2: return 0x10000 + rand() % (0x110000 - 0x10000);
+        default: return 1 + rand() % 0x7F;
+    }
+}
+
+// ************************************************
+// Tests
+// ************************************************
+
+static std::string Bytes(const char* hex) {
+    std::string bytes;
+    for (const char* p = hex; *p; ) {
+        if (*p == ' ') {
+            p++;
+            continue;
+        }
+        bytes += (char)strtoul(std::string(p, 2).c_str(), NULL, 16);
+        p += 2;
+    }
+    return bytes;
+}
+
+static Units Expected(const unsigned int* units, size_t count) {
+    return Units(units, units + count);
+}
+
+#define CHECK_DECODE(hex, ...) \
+    do { \
+        static const unsigned int expected[] = { __VA_ARGS__ }; \
+        CheckDecode(hex, Bytes(hex), Expected(expected, sizeof(expected) / sizeof(expected[0]))); \
+    } while (0)
+
+static void TestValid() {
+    CHECK(Decode("").empty());
+    CHECK_DECODE("41 42 43", 0x41, 0x42, 0x43);
+    CHECK_DECODE("C2 80 DF BF", 0x80, 0x7FF);
+    CHECK_DECODE("E0 A0 80 ED 9F BF EE 80 80 EF BF BF", 0x800, 0xD7FF, 0xE000, 0xFFFF);
+    CHECK_DECODE("F0 90 80 80", 0xD800, 0xDC00);
+    CHECK_DECODE("F0 9F 98 80", 0xD83D, 0xDE00);
+    CHECK_DECODE("F4 8F BF BF", 0xDBFF, 0xDFFF);
+}
+
+// One U+FFFD per maximal subpart of an ill-formed sequence (Unicode 6.0+, section 3.9)
+static void TestInvalid() {
+    CHECK_DECODE("80", 0xFFFD);
+    CHECK_DECODE("BF 41", 0xFFFD, 0x41);
+    CHECK_DECODE("C0 80", 0xFFFD, 0xFFFD);                          // Overlong NUL
+    CHECK_DECODE("C1 BF", 0xFFFD, 0xFFFD);
+    CHECK_DECODE("E0 80 80", 0xFFFD, 0xFFFD, 0xFFFD);               // Overlong 3 bytes
+    CHECK_DECODE("E0 9F BF", 0xFFFD, 0xFFFD, 0xFFFD);
+    CHECK_DECODE("F0 8F BF BF", 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD);    // Overlong 4 bytes
+    CHECK_DECODE("ED A0 80", 0xFFFD, 0xFFFD, 0xFFFD);               // High surrogate
+    CHECK_DECODE("ED BF BF", 0xFFFD, 0xFFFD, 0xFFFD);               // Low surrogate
+    CHECK_DECODE("ED A0 BD ED B8 80", 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD); // CESU-8 pair
+    CHECK_DECODE("F4 90 80 80", 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD);    // Above U+10FFFF
+    CHECK_DECODE("F5 80", 0xFFFD, 0xFFFD);
+    CHECK_DECODE("FE FF", 0xFFFD, 0xFFFD);
+    CHECK_DECODE("E2 82", 0xFFFD);                                  // Truncated at the end
+    CHECK_DECODE("F0 9F 98", 0xFFFD);
+    CHECK_DECODE("E2 82 41", 0xFFFD, 0x41);                         // Truncated before another character
+    CHECK_DECODE("F0 9F C2 80", 0xFFFD, 0x80);
+    CHECK_DECODE("61 F1 80 80 E1 80 C2 62 80 63 80 BF 64",
+                 0x61, 0xFFFD, 0xFFFD, 0xFFFD, 0x62, 0xFFFD, 0x63, 0xFFFD, 0xFFFD, 0x64);
+}
+
+// A non-ASCII character at every position of a run of ASCII, around the 16-byte chunks
+static void TestChunkBoundaries() {
+    static const char* const inserts[] = { "C3 A9", "E2 82 AC", "F0 9F 98 80", "80", "E2 82" };
+    for (size_t insert = 0; insert < sizeof(inserts) / sizeof(inserts[0]); insert++) {
+        std::string special = Bytes(inserts[insert]);
+        Units specialUnits = Decode(special);
+        for (size_t length = 0; length <= 48; length++) {
+            for (size_t position = 0; position <= length; position++) {
+                std::string bytes;
+                Units expected;
+                for (size_t i = 0; i < length; i++) {
+                    if (i == position) {
+                        bytes += special;
+                        expected.insert(expected.end(), specialUnits.begin(), specialUnits.end());
+                    }
+                    bytes += (char)('a' + i % 26);
+                    expected.push_back('a' + i % 26);
+                }
+                if (position == length) {
+                    bytes += special;
+                    expected.insert(expected.end(), specialUnits.begin(), specialUnits.end());
+                }
+                if (Decode(bytes) != expected) {
+                    fprintf(stderr, "chunk boundary: %s at %d of %d\n", inserts[insert], (int)position, (int)length);
+                    failures++;
+                }
+            }
+        }
+    }
+}
+
+// Random valid strings, decoded and compared with their UTF-16 encoding
+static void TestRandomValid() {
+    srand(42);
+    for (int round = 0; round < 20000; round++) {
+        std::string bytes;
+        Units expected;
+        int count = rand() % 100;
+        for (int i = 0; i < count; i++) {
+            unsigned int codePoint = RandomCodePoint();
+            AppendUtf8(bytes, codePoint);
+            AppendUtf16(expected, codePoint);
+        }
+        if (Decode(bytes) != expected) {
+            fprintf(stderr, "random valid string %d\n", round);
+            failures++;
+        }
+    }
+}
+
+// Random valid strings with a corrupted byte: the characters before it must be intact,
+// and the output is never longer than the input
+static void TestRandomCorrupted() {
+    srand(7);
+    for (int round = 0; round < 20000; round++) {
+        std::string bytes;
+        std::vector<size_t> starts;
+        int count = 1 + rand() % 60;
+        for (int i = 0; i < count; i++) {
+            starts.push_back(bytes.size());
+            AppendUtf8(bytes, RandomCodePoint());
+        }
+        size_t corrupted = rand() % bytes.size();
+        bytes[corrupted] = (char)(0x80 + rand() % 0x80);
+
+        // The characters that end before the corrupted byte
+        size_t lastStart = 0;
+        for (size_t i = 0; i < starts.size() && starts[i] <= corrupted; i++)
+            lastStart = starts[i];
+        Units intact = Decode(bytes.substr(0, lastStart));
+
+        Units units = Decode(bytes);
+        CHECK(units.size() >= intact.size());
+        CHECK(std::equal(intact.begin(), intact.end(), units.begin()));
+    }
+}
+
+int main() {
+    TestValid();
+    TestInvalid();
+    TestChunkBoundaries();
+    TestRandomValid();
+    TestRandomCorrupted();
+
+    if (failures) {
+        fprintf(stderr, "Utf8: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("Utf8: all checks passed\n");
+    return 0;
+}
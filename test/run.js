@@ -0,0 +1,24 @@
+// Runs the native tests built by node-gyp (the targets of binding.gyp whose name ends with "Test")
+var fs = require('fs'),
+    path = require('path'),
+    spawnSync = require('child_process').spawnSync,
+
+    buildDir = path.join(__dirname, '..', 'build', 'Release'),
+    tests = fs.readdirSync(buildDir).filter(function (file) {
+        return /Test(\.exe)?$/.test(file);
+    }),
+    failed = 0;
+
+tests.forEach(function (test) {
+    var result = spawnSync(path.join(buildDir, test), [], { stdio: 'inherit' });
+    if (result.status !== 0) {
+        console.error(test + ' failed');
+        failed++;
+    }
+});
+
+if (!tests.length) {
+    console.error('No tests found in ' + buildDir + ', run node-gyp rebuild first (with -- -Dbuild_tests=1 on Windows)');
+    process.exit(1);
+}
+process.exit(failed ? 1 : 0);